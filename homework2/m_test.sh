@@ -47,6 +47,58 @@ runtest 3 0
 runtest 4 0
 runtest 5 1
 
+# An image, with more threads than it needs.
+rm -f output.txt
+./mandelbrot --width 48 --height 27 --iterations 300 --threads 4 --view -2.2 -1.2 3 output.txt
+STATUS=$?
+if [ $STATUS -ne 0 ] || ! cmp -s m_expected_6.pgm output.txt; then
+  echo "**** Test 6 FAILED - image didn't match m_expected_6.pgm"
+  FAIL=1
+else
+  echo "Test 6 PASS"
+fi
+
+# Every kernel gives the same dwells.
+rm -f output.txt
+./mandelbrot --kernel scalar --width 48 --height 27 --iterations 300 --view -2.2 -1.2 3 output.txt
+STATUS=$?
+if [ $STATUS -ne 0 ] || ! cmp -s m_expected_6.pgm output.txt; then
+  echo "**** Test 7 FAILED - scalar kernel didn't match m_expected_6.pgm"
+  FAIL=1
+else
+  echo "Test 7 PASS"
+fi
+
+# Skipping the inside of the set doesn't change the image.
+rm -f output.txt
+./mandelbrot --no-interior --width 48 --height 27 --iterations 300 --view -2.2 -1.2 3 output.txt
+STATUS=$?
+if [ $STATUS -ne 0 ] || ! cmp -s m_expected_6.pgm output.txt; then
+  echo "**** Test 8 FAILED - --no-interior didn't match m_expected_6.pgm"
+  FAIL=1
+else
+  echo "Test 8 PASS"
+fi
+
+# Subdividing gives the same images as computing every pixel, for the views
+# in the first tests.
+LOCALFAIL=0
+for VIEW_NO in 1 2 3 4; do
+  VIEW=$(tr '\n' ' ' < m_input_$VIEW_NO.txt)
+  rm -f output.txt brute.pgm
+  ./mandelbrot --width 70 --height 35 --iterations 90 --view $VIEW brute.pgm
+  ./mandelbrot --subdivide --width 70 --height 35 --iterations 90 --view $VIEW output.txt
+  if [ $? -ne 0 ] || ! cmp -s brute.pgm output.txt; then
+    echo "**** Test 9 FAILED - --subdivide didn't match for the view in m_input_$VIEW_NO.txt"
+    FAIL=1
+    LOCALFAIL=1
+  fi
+done
+rm -f brute.pgm
+if [ $LOCALFAIL -eq 0 ]; then
+  echo "Test 9 PASS"
+fi
+
 if [ $FAIL -ne 0 ]; then
   echo "FAILING TESTS!"
   exit 13
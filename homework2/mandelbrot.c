@@ -2,10 +2,52 @@
  @file mandelbrot.c
  @author Sam Whitlock (sjwhitlo)
  The program prints out a reprsention of Mandelbrot based on user specified values.
+
+ Given any command line options, it renders an image instead, of any size and
+ with any dwell limit, as a binary PGM (or PPM with --ppm).  The image is cut
+ into tiles that are rendered on a pool of threads, one per processor unless
+ --threads says otherwise.  Each thread starts with its own share of the tiles
+ in a deque, and once it runs out it steals tiles from other threads chosen at
+ random, so threads that got the cheap tiles outside the set help out with the
+ expensive ones inside it.  --stats reports how long each thread was busy.
+
+ Pixels of an image are computed by a kernel picked for the processor when the
+ program starts: on x86, an AVX2 kernel working on 4 pixels at a time or an
+ SSE2 one working on 2, and otherwise a scalar one.  --kernel picks one by name.
+ All of them do the same double precision arithmetic in the same order, so
+ they give exactly the same dwells.
+
+ Points in the main cardioid and the period-2 bulb never escape, so they're
+ recognized with a closed-form test and given the full dwell without iterating.
+ Other points that don't escape usually settle into a cycle, and once z comes
+ back to exactly a value it had before, it will never escape either.  Both of
+ these are on unless --no-interior is given, and neither changes the output.
+
+ With --subdivide, each tile is rendered by Mariani-Silver subdivision instead:
+ only the border of a rectangle is computed, and if every pixel on it has the
+ same dwell, the inside is filled with that dwell without iterating.  Otherwise
+ the rectangle is split in two across its longer side and each half is handled
+ the same way.  This is much faster in large regions of one dwell, but a detail
+ smaller than a rectangle that doesn't reach its border can be missed.
  */
 
+#define _POSIX_C_SOURCE 200809L
+
 #include <stdio.h>
 #include <stdlib.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+#include <math.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <time.h>
+
+#if defined( __x86_64__ ) || defined( __i386__ )
+#include <immintrin.h>
+/** Defined if the SSE2 and AVX2 kernels are built. */
+#define X86_KERNELS
+#endif
 
 /** Dwell cut-off for drawing with ' ' */
 #define LEVEL_1 10
@@ -39,22 +81,220 @@
 /** Defines the width of the picture. */
 #define WIDTH 70
 
+/** Usage message for rendering an image. */
+#define USAGE "usage: mandelbrot [--width W] [--height H] [--iterations N] " \
+              "[--threads T] [--view minReal minImag size] [--kernel avx2|sse2|scalar] " \
+              "[--no-interior] [--subdivide] [--stats] [--ppm] " \
+              "<image_file>"
+/** Option for the width of the image, followed by the number of pixels. */
+#define WIDTH_OPT "--width"
+/** Option for the height of the image, followed by the number of pixels. */
+#define HEIGHT_OPT "--height"
+/** Option for the dwell limit, followed by the number of iterations. */
+#define ITERATIONS_OPT "--iterations"
+/** Option for the number of threads, followed by the number. */
+#define THREADS_OPT "--threads"
+/** Option for the part of the plane drawn, followed by three numbers. */
+#define VIEW_OPT "--view"
+/** Option for choosing the kernel, followed by its name. */
+#define KERNEL_OPT "--kernel"
+/** Option for reporting how busy each thread was. */
+#define STATS_OPT "--stats"
+/** Option for iterating every point to its full dwell. */
+#define INTERIOR_OPT "--no-interior"
+/** Option for rendering tiles by subdividing rectangles. */
+#define SUBDIVIDE_OPT "--subdivide"
+/** Option for writing a color PPM instead of a grayscale PGM. */
+#define PPM_OPT "--ppm"
+/** File name standing for standard output. */
+#define STD_STREAM "-"
+/** Format for reading a number, failing if anything follows it. */
+#define NUMBER_FORMAT "%lf%c"
+/** Default width and height of an image. */
+#define IMAGE_SIZE 1024
+/** Default dwell limit for an image. */
+#define ITERATIONS 1000
+/** Default minimum real value of an image, which shows the whole set. */
+#define VIEW_REAL -2.25
+/** Default minimum imaginary value of an image. */
+#define VIEW_IMAG -1.5
+/** Default width of the view of an image. */
+#define VIEW_SIZE 3.0
+/** Largest value of a pixel component. */
+#define MAX_COLOR 255
+/** Number of color channels in a PPM. */
+#define PPM_CHANNELS 3
+/** Width and height of a tile, in pixels. */
+#define TILE_SIZE 32
+/** Rectangles this narrow or short are computed pixel by pixel instead of
+    being subdivided further. */
+#define MIN_SUBDIVIDE 4
+/** Size of a cache line, used to keep the two ends of a deque apart. */
+#define CACHE_LINE 64
+/** Returned by stealTile() when there's nothing in the deque. */
+#define DEQUE_EMPTY -1
+/** Returned by stealTile() when another thread took the tile first. */
+#define STEAL_LOST -2
+/** Report of one thread's work for --stats. */
+#define THREAD_STATS "thread %d: busy %.3f s of %.3f s, %d tiles, %d stolen\n"
+/** Report of the pixels iterated for --stats. */
+#define PIXEL_STATS "iterated %ld of %ld pixels (%.1f%%)\n"
+/** Error for an image that doesn't fit in memory. */
+#define SIZE_ERROR "Image too large"
+/** Error for an image that can't be written. */
+#define WRITE_ERROR "Can't write image: %s\n"
+
+/** Number of pixels the SSE2 kernel works on at a time. */
+#define SSE2_LANES 2
+/** Number of pixels the AVX2 kernel works on at a time. */
+#define AVX2_LANES 4
+/** Square of the distance from the origin past which a point has escaped. */
+#define ESCAPE 4.0
+
 /**
- Calculates the dwell for the current point.
+ Computes the dwells of a list of points.
+ @param cReal The real value of each point.
+ @param cImag The imaginary value of each point.
+ @param n The number of points.
+ @param maxDwell The most iterations to try.
+ @param out Array the n dwells are stored in.
+ */
+typedef void (*PointKernel)( const double *cReal, const double *cImag, int n, int maxDwell,
+                             uint32_t *out );
+
+/** A kernel that can be picked by name. */
+typedef struct {
+  /** Name given with --kernel. */
+  const char *name;
+
+  /** The kernel. */
+  PointKernel kernel;
+} KernelChoice;
+
+/** An image being rendered. */
+typedef struct {
+  /** Width and height, in pixels. */
+  int width;
+  int height;
+
+  /** Dwell limit.  Points that reach it are taken to be in the set. */
+  int maxDwell;
+
+  /** The point at the left edge of the top row. */
+  double minReal;
+  double maxImag;
+
+  /** Distance between neighboring pixels, across and down. */
+  double step;
+
+  /** Dwell of each pixel, row by row. */
+  uint32_t *dwells;
+
+  /** True to render tiles with subdivide(). */
+  bool subdivide;
+
+  /** Number of tiles across the image. */
+  int tilesAcross;
+
+  /** The threads rendering the image. */
+  struct WorkerStruct *workers;
+
+  /** Number of threads. */
+  int workerCount;
+} Render;
+
+/** Deque of tiles owned by one thread.  The owner takes tiles from the
+    bottom, and other threads steal them from the top.  Tiles are never
+    added once rendering starts, so the array doesn't change. */
+typedef struct {
+  /** The tiles, by number. */
+  int *tiles;
+
+  /** Position of the next tile to steal. */
+  int top;
+
+  /** Keeps bottom off the cache line thieves write. */
+  char pad[ CACHE_LINE ];
+
+  /** Position past the owner's next tile. */
+  int bottom;
+} TileDeque;
+
+/** A thread rendering tiles, and how much work it did. */
+typedef struct WorkerStruct {
+  /** The image. */
+  Render *render;
+
+  /** Number of this thread. */
+  int id;
+
+  /** The thread. */
+  pthread_t thread;
+
+  /** Tiles this thread started out with. */
+  TileDeque deque;
+
+  /** State of the generator used to pick victims to steal from. */
+  uint32_t seed;
+
+  /** Seconds spent rendering tiles. */
+  double busy;
+
+  /** Number of tiles rendered, and how many of those were stolen. */
+  int tiles;
+  int stolen;
+
+  /** Number of pixels whose dwell was computed. */
+  long iterated;
+} Worker;
+
+/** True to skip iterating points known not to escape. */
+static bool skipInterior = true;
+
+/**
+ Checks whether a point is inside the main cardioid or the period-2 bulb of the
+ set, where every point is in the set.
+ @param cReal The real value of the point.
+ @param cImag The imaginary value of the point.
+ @return true if it's inside one of them.
+ */
+bool inMainBody( double cReal, double cImag )
+{
+    double imag2 = cImag * cImag;
+    double q = (cReal - 0.25) * (cReal - 0.25) + imag2;
+    if (q * (q + (cReal - 0.25)) < 0.25 * imag2) {
+        return true;
+    }
+    return (cReal + 1) * (cReal + 1) + imag2 < 0.0625;
+}
+
+/**
+ Calculates the dwell for a point, up to a limit.
  @param cReal The real value to calculate the dwell for.
  @param cImag The imaginary value to calculate the dwell for.
- @return The dwell.
+ @param maxDwell The most iterations to try.
+ @return The dwell, or maxDwell if the point didn't escape.
  */
-int testPoint( double cReal, double cImag )
+int pointDwell( double cReal, double cImag, int maxDwell )
 {
+    if (skipInterior && inMainBody(cReal, cImag)) {
+        return maxDwell;
+    }
+    
     // Copy parameters
     double zReal = cReal;
     double zImag = cImag;
     // Initialize dwell
     int dwell = 0;
     
+    // Brent's cycle detection: remember z whenever the dwell reaches a power
+    // of two, and compare each new z with it
+    double savedReal = zReal;
+    double savedImag = zImag;
+    long saveAt = 1;
+    
     // Compute the dwell
-    while (dwell < LEVEL_9 ) {
+    while (dwell < maxDwell ) {
         // z = z^2 + c
         double xReal = (zReal * zReal) - (zImag * zImag) + cReal;
         double xImag = 2 * zReal * zImag + cImag;
@@ -66,12 +306,33 @@ int testPoint( double cReal, double cImag )
         }
         // Increment dwell
         dwell++;
+        if (skipInterior) {
+            if (zReal == savedReal && zImag == savedImag) {
+                return maxDwell;
+            }
+            if (dwell == saveAt) {
+                savedReal = zReal;
+                savedImag = zImag;
+                saveAt *= 2;
+            }
+        }
     }
     
     // Return the dwell
     return dwell;
 }
 
+/**
+ Calculates the dwell for the current point.
+ @param cReal The real value to calculate the dwell for.
+ @param cImag The imaginary value to calculate the dwell for.
+ @return The dwell.
+ */
+int testPoint( double cReal, double cImag )
+{
+    return pointDwell(cReal, cImag, LEVEL_9);
+}
+
 /**
  Takes the int passed as a parameter and returns the char associated with that dwell value.
  @param dwell The dwell value.
@@ -138,13 +399,703 @@ void validateInput(int matches)
     exit(EXIT_FAILURE);
 }
 
+/**
+ Prints the usage message for rendering an image and exits.
+ */
+void usage()
+{
+    fprintf(stderr, "%s\n", USAGE);
+    exit(EXIT_FAILURE);
+}
+
+/**
+ Reads a number from a command line argument, exiting with the usage message
+ if it isn't one.
+ @param arg The argument.
+ @return The number.
+ */
+double parseNumber( const char *arg )
+{
+    double val;
+    char extra;
+    if (sscanf(arg, NUMBER_FORMAT, &val, &extra) != 1) {
+        usage();
+    }
+    return val;
+}
+
+/**
+ Reads a count, like a width or a number of threads, from a command line
+ argument, exiting with the usage message if it isn't a positive whole number.
+ @param arg The argument.
+ @return The count.
+ */
+int parseCount( const char *arg )
+{
+    double val = parseNumber(arg);
+    if (val < 1 || val > INT32_MAX || val != (int) val) {
+        usage();
+    }
+    return (int) val;
+}
+
+/**
+ Computes the dwells of a list of points, one at a time.
+ @param cReal The real value of each point.
+ @param cImag The imaginary value of each point.
+ @param n The number of points.
+ @param maxDwell The most iterations to try.
+ @param out Array the n dwells are stored in.
+ */
+void pointsScalar( const double *cReal, const double *cImag, int n, int maxDwell,
+                   uint32_t *out )
+{
+    for (int i = 0; i < n; i++) {
+        out[i] = pointDwell(cReal[i], cImag[i], maxDwell);
+    }
+}
+
+/**
+ Copies the next group of points for a vector kernel.  If fewer than a whole
+ group are left, the last one is repeated in the lanes past the end, so every
+ point is computed by the same kernel.
+ @param cReal The real value of each point.
+ @param cImag The imaginary value of each point.
+ @param n The number of points left, starting with this group.
+ @param lanes The number of points in a group.
+ @param re Array for the real values of the group.
+ @param im Array for the imaginary values of the group.
+ @param interior Array set to all ones for each point known not to escape.
+ */
+void loadGroup( const double *cReal, const double *cImag, int n, int lanes,
+                double *re, double *im, int64_t *interior )
+{
+    for (int lane = 0; lane < lanes; lane++) {
+        int i = lane < n ? lane : n - 1;
+        re[lane] = cReal[i];
+        im[lane] = cImag[i];
+        interior[lane] = skipInterior && inMainBody(re[lane], im[lane]) ? -1 : 0;
+    }
+}
+
+#ifdef X86_KERNELS
+/**
+ Computes the dwells of a list of points, 2 at a time with SSE2.  Each lane
+ does what pointDwell() does for its point, and drops out of the count once it
+ escapes.  The loop ends once every lane has escaped or reached the limit.
+ @param cReal The real value of each point.
+ @param cImag The imaginary value of each point.
+ @param n The number of points.
+ @param maxDwell The most iterations to try.
+ @param out Array the n dwells are stored in.
+ */
+__attribute__(( target( "sse2" ) ))
+void pointsSse2( const double *cReal, const double *cImag, int n, int maxDwell,
+                 uint32_t *out )
+{
+    const __m128d two = _mm_set1_pd(2);
+    const __m128d escape = _mm_set1_pd(ESCAPE);
+    for (int i = 0; i < n; i += SSE2_LANES) {
+        double re[SSE2_LANES];
+        double im[SSE2_LANES];
+        int64_t interior[SSE2_LANES];
+        loadGroup(cReal + i, cImag + i, n - i, SSE2_LANES, re, im, interior);
+        __m128d cr = _mm_loadu_pd(re);
+        __m128d ci = _mm_loadu_pd(im);
+        __m128d zr = cr;
+        __m128d zi = ci;
+        __m128d savedR = zr;
+        __m128d savedI = zi;
+        long saveAt = 1;
+
+        // Lanes still iterating are all ones, and subtracting that adds one.
+        // Lanes known not to escape are done, and get the full dwell.
+        __m128d done = _mm_castsi128_pd(_mm_loadu_si128((__m128i *) interior));
+        __m128d active = _mm_andnot_pd(done, _mm_castsi128_pd(_mm_set1_epi32(-1)));
+        __m128i dwell = _mm_setzero_si128();
+        for (int d = 0; d < maxDwell && _mm_movemask_pd(active); d++) {
+            __m128d xr = _mm_add_pd(_mm_sub_pd(_mm_mul_pd(zr, zr), _mm_mul_pd(zi, zi)), cr);
+            zi = _mm_add_pd(_mm_mul_pd(_mm_mul_pd(two, zr), zi), ci);
+            zr = xr;
+            __m128d mag = _mm_add_pd(_mm_mul_pd(zr, zr), _mm_mul_pd(zi, zi));
+            active = _mm_andnot_pd(_mm_cmpgt_pd(mag, escape), active);
+            dwell = _mm_sub_epi64(dwell, _mm_castpd_si128(active));
+            if (skipInterior) {
+                __m128d cycled = _mm_and_pd(active, _mm_and_pd(_mm_cmpeq_pd(zr, savedR),
+                                                               _mm_cmpeq_pd(zi, savedI)));
+                done = _mm_or_pd(done, cycled);
+                active = _mm_andnot_pd(cycled, active);
+                if (d + 1 == saveAt) {
+                    savedR = zr;
+                    savedI = zi;
+                    saveAt *= 2;
+                }
+            }
+        }
+
+        int64_t counts[SSE2_LANES];
+        _mm_storeu_si128((__m128i *) counts, dwell);
+        int finished = _mm_movemask_pd(done);
+        for (int lane = 0; lane < SSE2_LANES && i + lane < n; lane++) {
+            out[i + lane] = finished >> lane & 1 ? maxDwell : counts[lane];
+        }
+    }
+}
+
+/**
+ Computes the dwells of a list of points, 4 at a time with AVX2, in the same
+ way as pointsSse2().
+ @param cReal The real value of each point.
+ @param cImag The imaginary value of each point.
+ @param n The number of points.
+ @param maxDwell The most iterations to try.
+ @param out Array the n dwells are stored in.
+ */
+__attribute__(( target( "avx2" ) ))
+void pointsAvx2( const double *cReal, const double *cImag, int n, int maxDwell,
+                 uint32_t *out )
+{
+    const __m256d two = _mm256_set1_pd(2);
+    const __m256d escape = _mm256_set1_pd(ESCAPE);
+    for (int i = 0; i < n; i += AVX2_LANES) {
+        double re[AVX2_LANES];
+        double im[AVX2_LANES];
+        int64_t interior[AVX2_LANES];
+        loadGroup(cReal + i, cImag + i, n - i, AVX2_LANES, re, im, interior);
+        __m256d cr = _mm256_loadu_pd(re);
+        __m256d ci = _mm256_loadu_pd(im);
+        __m256d zr = cr;
+        __m256d zi = ci;
+        __m256d savedR = zr;
+        __m256d savedI = zi;
+        long saveAt = 1;
+
+        __m256d done = _mm256_castsi256_pd(_mm256_loadu_si256((__m256i *) interior));
+        __m256d active = _mm256_andnot_pd(done, _mm256_castsi256_pd(_mm256_set1_epi32(-1)));
+        __m256i dwell = _mm256_setzero_si256();
+        for (int d = 0; d < maxDwell && _mm256_movemask_pd(active); d++) {
+            __m256d xr = _mm256_add_pd(_mm256_sub_pd(_mm256_mul_pd(zr, zr),
+                                                     _mm256_mul_pd(zi, zi)), cr);
+            zi = _mm256_add_pd(_mm256_mul_pd(_mm256_mul_pd(two, zr), zi), ci);
+            zr = xr;
+            __m256d mag = _mm256_add_pd(_mm256_mul_pd(zr, zr), _mm256_mul_pd(zi, zi));
+            active = _mm256_andnot_pd(_mm256_cmp_pd(mag, escape, _CMP_GT_OQ), active);
+            dwell = _mm256_sub_epi64(dwell, _mm256_castpd_si256(active));
+            if (skipInterior) {
+                __m256d cycled = _mm256_and_pd(active, _mm256_and_pd(
+                                     _mm256_cmp_pd(zr, savedR, _CMP_EQ_OQ),
+                                     _mm256_cmp_pd(zi, savedI, _CMP_EQ_OQ)));
+                done = _mm256_or_pd(done, cycled);
+                active = _mm256_andnot_pd(cycled, active);
+                if (d + 1 == saveAt) {
+                    savedR = zr;
+                    savedI = zi;
+                    saveAt *= 2;
+                }
+            }
+        }
+
+        int64_t counts[AVX2_LANES];
+        _mm256_storeu_si256((__m256i *) counts, dwell);
+        int finished = _mm256_movemask_pd(done);
+        for (int lane = 0; lane < AVX2_LANES && i + lane < n; lane++) {
+            out[i + lane] = finished >> lane & 1 ? maxDwell : counts[lane];
+        }
+    }
+}
+#endif
+
+/** Kernels, best first. */
+static const KernelChoice kernels[] = {
+#ifdef X86_KERNELS
+    { "avx2", pointsAvx2 },
+    { "sse2", pointsSse2 },
+#endif
+    { "scalar", pointsScalar }
+};
+
+/** Kernel used to render pixels. */
+static PointKernel pointKernel = pointsScalar;
+
+/**
+ Checks whether this processor can run a kernel.
+ @param choice The kernel.
+ @return true if it can.
+ */
+bool kernelSupported( const KernelChoice *choice )
+{
+#ifdef X86_KERNELS
+    __builtin_cpu_init();
+    if (choice->kernel == pointsAvx2) {
+        return __builtin_cpu_supports("avx2");
+    } else if (choice->kernel == pointsSse2) {
+        return __builtin_cpu_supports("sse2");
+    }
+#endif
+    return true;
+}
+
+/**
+ Picks the kernel used to render pixels.
+ @param name The name of the kernel, or NULL for the best one this processor
+ can run.
+ @return false if there's no kernel with that name this processor can run.
+ */
+bool chooseKernel( const char *name )
+{
+    for (int i = 0; i < sizeof(kernels) / sizeof(kernels[0]); i++) {
+        if ((!name || strcmp(name, kernels[i].name) == 0) && kernelSupported(kernels + i)) {
+            pointKernel = kernels[i].kernel;
+            return true;
+        }
+    }
+    return false;
+}
+
+/**
+ Returns the time, for measuring how long something took.
+ @return Seconds since some fixed point in the past.
+ */
+double now()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/**
+ Computes the dwells of a span of pixels in a row.
+ @param worker The thread doing the work, which counts the pixels.
+ @param x The first pixel of the span.
+ @param y The row.
+ @param n The number of pixels.
+ */
+void computeSpan( Worker *worker, int x, int y, int n )
+{
+    Render *render = worker->render;
+    double cReal[TILE_SIZE];
+    double cImag[TILE_SIZE];
+    for (int i = 0; i < n; i++) {
+        cReal[i] = render->minReal + (x + i) * render->step;
+        cImag[i] = render->maxImag - y * render->step;
+    }
+    pointKernel(cReal, cImag, n, render->maxDwell,
+                render->dwells + (size_t) y * render->width + x);
+    worker->iterated += n;
+}
+
+/**
+ Computes the dwells of a span of pixels in a column.
+ @param worker The thread doing the work, which counts the pixels.
+ @param x The column.
+ @param y The first pixel of the span.
+ @param n The number of pixels.
+ */
+void computeColumn( Worker *worker, int x, int y, int n )
+{
+    Render *render = worker->render;
+    double cReal[TILE_SIZE] = { 0 };
+    double cImag[TILE_SIZE] = { 0 };
+    uint32_t dwells[TILE_SIZE];
+    for (int i = 0; i < n; i++) {
+        cReal[i] = render->minReal + x * render->step;
+        cImag[i] = render->maxImag - (y + i) * render->step;
+    }
+    pointKernel(cReal, cImag, n, render->maxDwell, dwells);
+    for (int i = 0; i < n; i++) {
+        render->dwells[(size_t) (y + i) * render->width + x] = dwells[i];
+    }
+    worker->iterated += n;
+}
+
+/**
+ Fills in a rectangle whose border has already been computed.  If the border
+ has one dwell, the inside gets it too.  Otherwise the rectangle is split across
+ its longer side, the line between the halves is computed, and each half is
+ filled in the same way.
+ @param worker The thread doing the work.
+ @param left The left column of the rectangle.
+ @param top The top row.
+ @param width The width, in pixels, counting both sides.
+ @param height The height.
+ */
+void subdivide( Worker *worker, int left, int top, int width, int height )
+{
+    Render *render = worker->render;
+    if (width <= 2 || height <= 2) {
+        return;
+    }
+    if (width <= MIN_SUBDIVIDE || height <= MIN_SUBDIVIDE) {
+        for (int y = top + 1; y < top + height - 1; y++) {
+            computeSpan(worker, left + 1, y, width - 2);
+        }
+        return;
+    }
+
+    // See if the top and bottom rows and the two sides all match
+    uint32_t *topRow = render->dwells + (size_t) top * render->width + left;
+    uint32_t *bottomRow = topRow + (size_t) (height - 1) * render->width;
+    uint32_t dwell = topRow[0];
+    bool same = true;
+    for (int x = 0; same && x < width; x++) {
+        same = topRow[x] == dwell && bottomRow[x] == dwell;
+    }
+    for (int y = 1; same && y < height - 1; y++) {
+        same = topRow[(size_t) y * render->width] == dwell
+               && topRow[(size_t) y * render->width + width - 1] == dwell;
+    }
+    if (same) {
+        for (int y = 1; y < height - 1; y++) {
+            uint32_t *row = topRow + (size_t) y * render->width;
+            for (int x = 1; x < width - 1; x++) {
+                row[x] = dwell;
+            }
+        }
+        return;
+    }
+
+    // The halves share the line between them
+    if (width >= height) {
+        int mid = left + width / 2;
+        computeColumn(worker, mid, top + 1, height - 2);
+        subdivide(worker, left, top, mid - left + 1, height);
+        subdivide(worker, mid, top, left + width - mid, height);
+    } else {
+        int mid = top + height / 2;
+        computeSpan(worker, left + 1, mid, width - 2);
+        subdivide(worker, left, top, width, mid - top + 1);
+        subdivide(worker, left, mid, width, top + height - mid);
+    }
+}
+
+/**
+ Renders one tile of an image, either a row of pixels at a time or, with
+ --subdivide, by computing its border and then subdividing it.
+ @param worker The thread doing the work.
+ @param tile The number of the tile, counting across each row of tiles.
+ */
+void renderTile( Worker *worker, int tile )
+{
+    Render *render = worker->render;
+    int left = tile % render->tilesAcross * TILE_SIZE;
+    int top = tile / render->tilesAcross * TILE_SIZE;
+    int width = render->width - left < TILE_SIZE ? render->width - left : TILE_SIZE;
+    int height = render->height - top < TILE_SIZE ? render->height - top : TILE_SIZE;
+    if (!render->subdivide) {
+        for (int y = top; y < top + height; y++) {
+            computeSpan(worker, left, y, width);
+        }
+        return;
+    }
+
+    computeSpan(worker, left, top, width);
+    if (height > 1) {
+        computeSpan(worker, left, top + height - 1, width);
+    }
+    if (height > 2) {
+        computeColumn(worker, left, top + 1, height - 2);
+        if (width > 1) {
+            computeColumn(worker, left + width - 1, top + 1, height - 2);
+        }
+    }
+    subdivide(worker, left, top, width, height);
+}
+
+/**
+ Takes the tile at the bottom of a thread's own deque.
+ @param deque The deque, owned by the calling thread.
+ @return The tile, or -1 if the deque is empty.
+ */
+int popTile( TileDeque *deque )
+{
+    // Claim the bottom tile first, then see if a thief got to it too
+    int bottom = deque->bottom - 1;
+    __atomic_store_n(&deque->bottom, bottom, __ATOMIC_SEQ_CST);
+    int top = __atomic_load_n(&deque->top, __ATOMIC_SEQ_CST);
+    if (top > bottom) {
+        __atomic_store_n(&deque->bottom, bottom + 1, __ATOMIC_SEQ_CST);
+        return -1;
+    }
+    int tile = deque->tiles[bottom];
+
+    // For the last tile, the owner and a thief race for the top
+    if (top == bottom) {
+        if (!__atomic_compare_exchange_n(&deque->top, &top, top + 1, false,
+                                         __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST)) {
+            tile = -1;
+        }
+        __atomic_store_n(&deque->bottom, bottom + 1, __ATOMIC_SEQ_CST);
+    }
+    return tile;
+}
+
+/**
+ Steals the tile at the top of another thread's deque.
+ @param deque The deque.
+ @return The tile, DEQUE_EMPTY if the deque is empty, or STEAL_LOST if
+ another thread took the tile first and there may be more.
+ */
+int stealTile( TileDeque *deque )
+{
+    int top = __atomic_load_n(&deque->top, __ATOMIC_SEQ_CST);
+    int bottom = __atomic_load_n(&deque->bottom, __ATOMIC_SEQ_CST);
+    if (top >= bottom) {
+        return DEQUE_EMPTY;
+    }
+    int tile = deque->tiles[top];
+    if (!__atomic_compare_exchange_n(&deque->top, &top, top + 1, false,
+                                     __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST)) {
+        return STEAL_LOST;
+    }
+    return tile;
+}
+
+/**
+ Renders a tile, and counts it as work done by a thread.
+ @param worker The thread.
+ @param tile The tile.
+ @param stolen True if it came from another thread's deque.
+ */
+void doTile( Worker *worker, int tile, bool stolen )
+{
+    double start = now();
+    renderTile(worker, tile);
+    worker->busy += now() - start;
+    worker->tiles++;
+    worker->stolen += stolen;
+}
+
+/**
+ Renders tiles until there are none left.  Each thread in the pool runs this,
+ working through its own deque and then stealing from the others.
+ @param arg The thread's Worker.
+ @return NULL
+ */
+void *renderWorker( void *arg )
+{
+    Worker *worker = (Worker *) arg;
+    Render *render = worker->render;
+    int tile;
+    while ((tile = popTile(&worker->deque)) >= 0) {
+        doTile(worker, tile, false);
+    }
+
+    // Sweep the other deques from a random one, stealing until a whole sweep
+    // finds them all empty.  Tiles are never added once rendering starts, so
+    // then there's nothing left to take; the threads still on a tile finish
+    // it, and pthread_join() waits for them
+    bool found = render->workerCount > 1;
+    while (found) {
+        worker->seed ^= worker->seed << 13;
+        worker->seed ^= worker->seed >> 17;
+        worker->seed ^= worker->seed << 5;
+        int first = worker->seed % (render->workerCount - 1);
+        found = false;
+        for (int i = 0; i < render->workerCount - 1 && !found; i++) {
+            int victim = (first + i) % (render->workerCount - 1);
+            victim += victim >= worker->id;
+            tile = stealTile(&render->workers[victim].deque);
+            if (tile >= 0) {
+                doTile(worker, tile, true);
+            }
+            found = tile != DEQUE_EMPTY;
+        }
+    }
+    return NULL;
+}
+
+/**
+ Renders the whole of an image on a pool of threads, giving each one an even
+ share of the tiles to start with.
+ @param render The image.
+ @param threads The number of threads.
+ @param stats True to report how busy each thread was on standard error.
+ */
+void renderImage( Render *render, int threads, bool stats )
+{
+    render->tilesAcross = (render->width + TILE_SIZE - 1) / TILE_SIZE;
+    int tiles = render->tilesAcross * ((render->height + TILE_SIZE - 1) / TILE_SIZE);
+    render->workerCount = threads;
+    render->workers = (Worker *) malloc(threads * sizeof(Worker));
+    int *order = (int *) malloc(tiles * sizeof(int));
+    for (int i = 0; i < tiles; i++) {
+        order[i] = i;
+    }
+
+    // Each thread gets a band of the image.  The owner works from the bottom
+    // of its band up and thieves take from the top down.
+    for (int i = 0; i < threads; i++) {
+        Worker *worker = render->workers + i;
+        worker->render = render;
+        worker->id = i;
+        worker->deque.tiles = order;
+        worker->deque.top = (long) tiles * i / threads;
+        worker->deque.bottom = (long) tiles * (i + 1) / threads;
+        worker->seed = 2654435761u * (i + 1);
+        worker->busy = 0;
+        worker->tiles = 0;
+        worker->stolen = 0;
+        worker->iterated = 0;
+    }
+    double start = now();
+    for (int i = 0; i < threads; i++) {
+        pthread_create(&render->workers[i].thread, NULL, renderWorker, render->workers + i);
+    }
+    for (int i = 0; i < threads; i++) {
+        pthread_join(render->workers[i].thread, NULL);
+    }
+    double elapsed = now() - start;
+
+    if (stats) {
+        long iterated = 0;
+        for (int i = 0; i < threads; i++) {
+            Worker *worker = render->workers + i;
+            fprintf(stderr, THREAD_STATS, i, worker->busy, elapsed, worker->tiles,
+                    worker->stolen);
+            iterated += worker->iterated;
+        }
+        long pixels = (long) render->width * render->height;
+        fprintf(stderr, PIXEL_STATS, iterated, pixels, iterated * 100.0 / pixels);
+    }
+    free(order);
+    free(render->workers);
+}
+
+/**
+ Writes a rendered image as a binary PGM or PPM.  Points in the set are black,
+ and the rest get brighter as their dwell grows, on a log scale so the detail
+ near the set still shows up with a high dwell limit.
+ @param render The image.
+ @param color True for a PPM, false for a PGM.
+ @param fp The file to write to.
+ @return false if the image couldn't be written.
+ */
+bool writeImage( Render *render, bool color, FILE *fp )
+{
+    // Work out the color for each dwell once
+    int channels = color ? PPM_CHANNELS : 1;
+    unsigned char *palette = (unsigned char *) calloc(render->maxDwell + 1, channels);
+    for (int dwell = 0; dwell < render->maxDwell; dwell++) {
+        double t = log(dwell + 1) / log(render->maxDwell + 1);
+        unsigned char *entry = palette + dwell * channels;
+        if (color) {
+            entry[0] = MAX_COLOR * 9 * (1 - t) * t * t * t;
+            entry[1] = MAX_COLOR * 15 * (1 - t) * (1 - t) * t * t;
+            entry[2] = MAX_COLOR * 8.5 * (1 - t) * (1 - t) * (1 - t) * t;
+        } else {
+            entry[0] = MAX_COLOR * t;
+        }
+    }
+
+    fprintf(fp, "P%d\n%d %d\n%d\n", color ? 6 : 5, render->width, render->height,
+            MAX_COLOR);
+    unsigned char *line = (unsigned char *) malloc((size_t) render->width * channels);
+    bool ok = true;
+    for (int y = 0; ok && y < render->height; y++) {
+        const uint32_t *row = render->dwells + (size_t) y * render->width;
+        for (int x = 0; x < render->width; x++) {
+            memcpy(line + x * channels, palette + row[x] * channels, channels);
+        }
+        ok = fwrite(line, channels, render->width, fp) == render->width;
+    }
+
+    free(line);
+    free(palette);
+    return ok;
+}
+
+/**
+ Renders an image with the options given on the command line.
+ @param argc The number of command line arguments.
+ @param argv The command line arguments.
+ @return EXIT_SUCCESS for successful termination
+ */
+int renderMain( int argc, char *argv[] )
+{
+    Render render;
+    render.subdivide = false;
+    render.width = IMAGE_SIZE;
+    render.height = IMAGE_SIZE;
+    render.maxDwell = ITERATIONS;
+    double minReal = VIEW_REAL;
+    double minImag = VIEW_IMAG;
+    double size = VIEW_SIZE;
+    long processors = sysconf(_SC_NPROCESSORS_ONLN);
+    int threads = processors > 0 ? processors : 1;
+    bool color = false;
+    bool stats = false;
+    char *kernel = NULL;
+    char *fname = NULL;
+    for (int i = 1; i < argc; i++) {
+        bool more = i + 1 < argc;
+        if (strcmp(argv[i], WIDTH_OPT) == 0 && more) {
+            render.width = parseCount(argv[++i]);
+        } else if (strcmp(argv[i], HEIGHT_OPT) == 0 && more) {
+            render.height = parseCount(argv[++i]);
+        } else if (strcmp(argv[i], ITERATIONS_OPT) == 0 && more) {
+            render.maxDwell = parseCount(argv[++i]);
+        } else if (strcmp(argv[i], THREADS_OPT) == 0 && more) {
+            threads = parseCount(argv[++i]);
+        } else if (strcmp(argv[i], VIEW_OPT) == 0 && i + 3 < argc) {
+            minReal = parseNumber(argv[++i]);
+            minImag = parseNumber(argv[++i]);
+            size = parseNumber(argv[++i]);
+        } else if (strcmp(argv[i], KERNEL_OPT) == 0 && more) {
+            kernel = argv[++i];
+        } else if (strcmp(argv[i], INTERIOR_OPT) == 0) {
+            skipInterior = false;
+        } else if (strcmp(argv[i], SUBDIVIDE_OPT) == 0) {
+            render.subdivide = true;
+        } else if (strcmp(argv[i], STATS_OPT) == 0) {
+            stats = true;
+        } else if (strcmp(argv[i], PPM_OPT) == 0) {
+            color = true;
+        } else if (!fname && (argv[i][0] != '-' || strcmp(argv[i], STD_STREAM) == 0)) {
+            fname = argv[i];
+        } else {
+            usage();
+        }
+    }
+    if (!fname || size <= 0 || !chooseKernel(kernel)) {
+        usage();
+    }
+
+    // Pixels are square, and size is the width of the view, so the height of
+    // the view follows from the shape of the image
+    render.step = size / (render.width > 1 ? render.width - 1 : 1);
+    render.minReal = minReal;
+    render.maxImag = minImag + render.step * (render.height - 1);
+    render.dwells = (uint32_t *) malloc((size_t) render.width * render.height
+                                        * sizeof(uint32_t));
+    if (!render.dwells) {
+        fprintf(stderr, "%s\n", SIZE_ERROR);
+        exit(EXIT_FAILURE);
+    }
+    renderImage(&render, threads, stats);
+
+    FILE *fp = strcmp(fname, STD_STREAM) == 0 ? stdout : fopen(fname, "wb");
+    if (!fp || !writeImage(&render, color, fp) || fclose(fp) != 0) {
+        fprintf(stderr, WRITE_ERROR, fname);
+        exit(EXIT_FAILURE);
+    }
+    free(render.dwells);
+    return EXIT_SUCCESS;
+}
+
 /**
  The main function in the program. It takes values for minReal, minImag, and size,
  and displays a represention of the Mandelbrot figure for those values.
+ With command line options, it renders an image instead.
+ @param argc The number of command line arguments.
+ @param argv The command line arguments.
  @return EXIT_SUCCESS for successful termination
  */
-int main()
+int main( int argc, char *argv[] )
 {
+    if (argc > 1) {
+        return renderMain(argc, argv);
+    }
+    
     // Declare variables
     double minReal;
     double minImag;
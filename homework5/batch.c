@@ -0,0 +1,158 @@
+/**
+ * @file batch.c
+ * @author Sam Whitlock (sjwhitlo)
+ *
+ * Reading batch lists and whole files for the --batch option.
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "batch.h"
+
+/** Format for reading one pair of names, limited to BATCH_NAME - 1 chars. */
+#define PAIR_FORMAT " %4095s %4095s"
+/** File name standing for standard input. */
+#define STD_STREAM "-"
+/** Initial capacity of the list, and of a file read in. */
+#define INIT_SIZE 64
+/** Status of a file that was processed. */
+#define BATCH_OK "%s: ok\n"
+/** Status of a file that failed. */
+#define BATCH_FAILED "%s: %s\n"
+
+/**
+ * Reads a batch list.  "-" reads it from standard input.
+ *
+ * @param fname The name of the list
+ * @param count Set to the number of pairs
+ * @return The pairs, or NULL if the list can't be opened or a line
+ * doesn't have two names
+ */
+BatchFile *readBatchList( const char *fname, int *count )
+{
+    FILE *fp = strcmp(fname, STD_STREAM) == 0 ? stdin : fopen(fname, "r");
+    if (!fp) {
+        return NULL;
+    }
+
+    int capacity = INIT_SIZE;
+    BatchFile *files = (BatchFile *)malloc(capacity * sizeof(BatchFile));
+    *count = 0;
+    char input[BATCH_NAME];
+    char output[BATCH_NAME];
+    int matched;
+    while ((matched = fscanf(fp, PAIR_FORMAT, input, output)) == 2) {
+        if (*count == capacity) {
+            capacity *= 2;
+            files = (BatchFile *)realloc(files, capacity * sizeof(BatchFile));
+        }
+        BatchFile *file = files + (*count)++;
+        file->input = strdup(input);
+        file->output = strdup(output);
+        file->ok = false;
+        file->message[0] = '\0';
+    }
+    if (fp != stdin) {
+        fclose(fp);
+    }
+
+    // A name without a partner means the list is damaged
+    if (matched == 1) {
+        freeBatchList(files, *count);
+        return NULL;
+    }
+    return files;
+}
+
+/**
+ * Reads the whole of a file into memory, with a null after the end.
+ *
+ * @param fname The name of the file
+ * @param len Set to the number of bytes read
+ * @return The contents, or NULL if the file can't be opened
+ */
+char *readWholeFile( const char *fname, size_t *len )
+{
+    FILE *fp = fopen(fname, "rb");
+    if (!fp) {
+        return NULL;
+    }
+
+    // Double the buffer until the read comes up short
+    size_t capacity = INIT_SIZE;
+    char *buf = (char *)malloc(capacity + 1);
+    *len = 0;
+    size_t count;
+    while ((count = fread(buf + *len, 1, capacity - *len, fp)) > 0) {
+        *len += count;
+        if (*len == capacity) {
+            capacity *= 2;
+            buf = (char *)realloc(buf, capacity + 1);
+        }
+    }
+    fclose(fp);
+    buf[*len] = '\0';
+
+    return buf;
+}
+
+/**
+ * Writes a buffer to a new file.
+ *
+ * @param fname The name of the file
+ * @param buf The bytes to write
+ * @param len The number of bytes
+ * @return false if the file couldn't be written
+ */
+bool writeWholeFile( const char *fname, const void *buf, size_t len )
+{
+    FILE *fp = fopen(fname, "wb");
+    if (!fp) {
+        return false;
+    }
+    bool ok = fwrite(buf, 1, len, fp) == len;
+    if (fclose(fp) != 0) {
+        ok = false;
+    }
+    return ok;
+}
+
+/**
+ * Prints the status of each file in a batch, in the order of the list.
+ *
+ * @param files The pairs
+ * @param count The number of pairs
+ * @return The number that failed
+ */
+int reportBatch( BatchFile *files, int count )
+{
+    int failed = 0;
+    for (int i = 0; i < count; i++) {
+        if (files[i].ok) {
+            printf(BATCH_OK, files[i].input);
+        } else {
+            printf(BATCH_FAILED, files[i].input, files[i].message);
+            failed++;
+        }
+    }
+    return failed;
+}
+
+/**
+ * Frees a batch list.
+ *
+ * @param files The pairs
+ * @param count The number of pairs
+ */
+void freeBatchList( BatchFile *files, int count )
+{
+    for (int i = 0; i < count; i++) {
+        free(files[i].input);
+        free(files[i].output);
+    }
+    free(files);
+}
@@ -0,0 +1,84 @@
+/**
+ * @file batch.h
+ * @author Sam Whitlock (sjwhitlo)
+ *
+ * Header file for batch.c, which supports the --batch option of pack
+ * and unpack.  A batch list names one input file and one output file
+ * on each line, separated by white space.  Each pair is processed on
+ * its own, and its status is reported without stopping the rest.
+ */
+
+#ifndef _BATCH_H_
+#define _BATCH_H_
+
+#include <stdbool.h>
+#include <stddef.h>
+
+/** Longest file name in a batch list. */
+#define BATCH_NAME 4096
+
+/** Size of the message recorded for a file that failed. */
+#define BATCH_MESSAGE 80
+
+/** One pair of files in a batch. */
+typedef struct {
+  /** Name of the file to read. */
+  char *input;
+
+  /** Name of the file to write. */
+  char *output;
+
+  /** True once the file has been processed successfully. */
+  bool ok;
+
+  /** Why the file failed, if it did. */
+  char message[ BATCH_MESSAGE ];
+} BatchFile;
+
+/**
+ * Reads a batch list.  "-" reads it from standard input.
+ *
+ * @param fname The name of the list
+ * @param count Set to the number of pairs
+ * @return The pairs, or NULL if the list can't be opened or a line
+ * doesn't have two names
+ */
+BatchFile *readBatchList( const char *fname, int *count );
+
+/**
+ * Reads the whole of a file into memory, with a null after the end.
+ *
+ * @param fname The name of the file
+ * @param len Set to the number of bytes read
+ * @return The contents, or NULL if the file can't be opened
+ */
+char *readWholeFile( const char *fname, size_t *len );
+
+/**
+ * Writes a buffer to a new file.
+ *
+ * @param fname The name of the file
+ * @param buf The bytes to write
+ * @param len The number of bytes
+ * @return false if the file couldn't be written
+ */
+bool writeWholeFile( const char *fname, const void *buf, size_t len );
+
+/**
+ * Prints the status of each file in a batch, in the order of the list.
+ *
+ * @param files The pairs
+ * @param count The number of pairs
+ * @return The number that failed
+ */
+int reportBatch( BatchFile *files, int count );
+
+/**
+ * Frees a batch list.
+ *
+ * @param files The pairs
+ * @param count The number of pairs
+ */
+void freeBatchList( BatchFile *files, int count );
+
+#endif
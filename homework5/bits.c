@@ -7,6 +7,12 @@
 
 #include <stdio.h>
 
+#if defined( __x86_64__ ) || defined( __i386__ )
+#include <immintrin.h>
+/** Defined if the SSSE3 decoder is built, to be picked at run time. */
+#define X86_DECODER
+#endif
+
 #include "bits.h"
 
 /** Ints for an array of masks. */
@@ -69,6 +75,54 @@ void flushBits( PendingBits *pending, FILE *fp )
     }
 }
 
+/** Bits stored from the register at a time. */
+#define WORD_BITS 32
+/** Bits in the 64-bit values used while decoding. */
+#define REGISTER_BITS 64
+/** Most bytes a single code can span. */
+#define CODE_SPAN 3
+
+/** Start a bit writer storing its output in the given buffer.
+ @param writer the bit writer to initialize.
+ @param buf buffer the output is stored in.
+ @param codeBits number of bits in each code.
+ */
+void initBitWriter( BitWriter *writer, unsigned char *buf, int codeBits )
+{
+    writer->codeBits = codeBits;
+    writer->acc = 0;
+    writer->bitCount = 0;
+    writer->buf = buf;
+    writer->len = 0;
+}
+
+/** Store any bits left in the writer's register, with the last,
+ partial byte padded with zeros in its high-order bits.
+ @param writer the bit writer.
+ */
+void finishCodes( BitWriter *writer )
+{
+    while (writer->bitCount > 0) {
+        writer->buf[writer->len++] = writer->acc & 0xFF;
+        writer->acc >>= BITS_PER_BYTE;
+        writer->bitCount -= BITS_PER_BYTE;
+    }
+    writer->acc = 0;
+    writer->bitCount = 0;
+}
+
+/** Write out the bytes stored in the writer's buffer, then empty it.
+ @param writer the bit writer.
+ @param fp file the bytes are written to, opened for writing.
+ @return false if the bytes couldn't be written.
+ */
+bool drainCodes( BitWriter *writer, FILE *fp )
+{
+    bool ok = fwrite(writer->buf, 1, writer->len, fp) == writer->len;
+    writer->len = 0;
+    return ok;
+}
+
 /** Read and return the next 9-bit code from the given file.
  @param pending pointer to storage for left-over bits read during
  the last call to readCode().
@@ -81,7 +135,7 @@ int readCode( PendingBits *pending, FILE *fp )
     // Define the masks
     int mask[] = {MASKS};
     // Temp storage for bits
-    char tmpBits;
+    int tmpBits;
     // If there are 0 pending bits, read the next byte to pending
     // Set pending bits to 8
     if (pending->bitCount == 0) {
@@ -120,3 +174,226 @@ int readCode( PendingBits *pending, FILE *fp )
     // Return the int
     return code;
 }
+
+/** Number of bytes loaded to decode a group of codes.  This is enough
+    for a group of the widest codes, and for the SSSE3 decoder. */
+#define GROUP_LOAD 16
+
+/**
+ Put together up to 8 bytes, low-order byte first.
+ @param in the bytes.
+ @param count the number of bytes.
+ @return their value.
+ */
+static inline uint64_t loadBytes( const unsigned char *in, int count )
+{
+    uint64_t word = 0;
+    for ( int i = 0; i < count; i++ ) {
+        word |= (uint64_t)in[ i ] << ( i * BITS_PER_BYTE );
+    }
+    return word;
+}
+
+/**
+ Defines NAME(), the bulk reader for N-bit codes, which decodes whole
+ groups with GROUP() and the leftover bytes one code at a time.
+ */
+#define DEFINE_READ_CODES( NAME, N, GROUP )                                 \
+static size_t NAME( const unsigned char *in, size_t len, uint16_t *codes )\
+{                                                                           \
+    size_t n = 0;                                                           \
+    size_t pos = 0;                                                         \
+                                                                            \
+    /* Whole groups, as long as it's safe to load GROUP_LOAD bytes */       \
+    while ( pos + GROUP_LOAD <= len ) {                                     \
+        GROUP( in + pos, codes + n );                                       \
+        pos += N;                                                           \
+        n += GROUP_CODES;                                                   \
+    }                                                                       \
+                                                                            \
+    /* Codes in the leftover bytes, one at a time */                        \
+    size_t bits = ( len - pos ) * BITS_PER_BYTE;                            \
+    for ( size_t bit = 0; bit + N <= bits; bit += N ) {                     \
+        size_t at = pos + bit / BITS_PER_BYTE;                              \
+        int count = len - at < CODE_SPAN ? len - at : CODE_SPAN;            \
+        codes[ n++ ] = ( loadBytes( in + at, count ) >> ( bit % BITS_PER_BYTE ) ) \
+            & ( ( 1 << N ) - 1 );                                           \
+    }                                                                       \
+                                                                            \
+    return n;                                                               \
+}
+
+/**
+ Defines writeCodesN(), readGroupN() and readCodesN(), the bulk writer
+ and readers for N-bit codes.  Each width gets its own copy, so all the
+ shifts and masks in the inner loops are constants.
+ */
+#define DEFINE_CODE_IO( N )                                                 \
+static void writeCodes##N( const uint16_t *codes, size_t n,                 \
+                           BitWriter *writer )                              \
+{                                                                           \
+    /* Work on local copies so they can live in registers */                \
+    uint64_t acc = writer->acc;                                             \
+    int bitCount = writer->bitCount;                                        \
+    unsigned char *out = writer->buf + writer->len;                         \
+                                                                            \
+    for ( size_t i = 0; i < n; i++ ) {                                      \
+        /* Codes go in above the bits we already have, like writeCode() */  \
+        acc |= (uint64_t)codes[ i ] << bitCount;                            \
+        bitCount += N;                                                      \
+                                                                            \
+        /* Store a whole word, low-order byte first */                      \
+        if ( bitCount >= WORD_BITS ) {                                      \
+            out[ 0 ] = acc & 0xFF;                                          \
+            out[ 1 ] = ( acc >> BITS_PER_BYTE ) & 0xFF;                     \
+            out[ 2 ] = ( acc >> ( 2 * BITS_PER_BYTE ) ) & 0xFF;             \
+            out[ 3 ] = ( acc >> ( 3 * BITS_PER_BYTE ) ) & 0xFF;             \
+            out += WORD_BITS / BITS_PER_BYTE;                               \
+            acc >>= WORD_BITS;                                              \
+            bitCount -= WORD_BITS;                                          \
+        }                                                                   \
+    }                                                                       \
+                                                                            \
+    writer->acc = acc;                                                      \
+    writer->bitCount = bitCount;                                            \
+    writer->len = out - writer->buf;                                        \
+}                                                                           \
+                                                                            \
+static void readGroup##N( const unsigned char *in, uint16_t *codes )        \
+{                                                                           \
+    /* A group of N bytes fits in two 64-bit values */                      \
+    uint64_t lo = loadBytes( in, BITS_PER_BYTE );                           \
+    uint64_t hi = loadBytes( in + BITS_PER_BYTE, BITS_PER_BYTE );           \
+    uint64_t mask = ( 1 << N ) - 1;                                         \
+                                                                            \
+    /* With k and N constant, only one of these cases is compiled in */     \
+    for ( int k = 0; k < GROUP_CODES; k++ ) {                               \
+        int bit = k * N;                                                    \
+        if ( bit + N <= REGISTER_BITS ) {                                   \
+            codes[ k ] = ( lo >> bit ) & mask;                              \
+        } else if ( bit >= REGISTER_BITS ) {                                \
+            codes[ k ] = ( hi >> ( bit - REGISTER_BITS ) ) & mask;          \
+        } else {                                                            \
+            codes[ k ] = ( ( lo >> bit )                                    \
+                           | ( hi << ( REGISTER_BITS - bit ) ) ) & mask;    \
+        }                                                                   \
+    }                                                                       \
+}                                                                           \
+                                                                            \
+DEFINE_READ_CODES( readCodes##N, N, readGroup##N )
+
+DEFINE_CODE_IO( 9 )
+DEFINE_CODE_IO( 10 )
+DEFINE_CODE_IO( 11 )
+DEFINE_CODE_IO( 12 )
+DEFINE_CODE_IO( 13 )
+DEFINE_CODE_IO( 14 )
+DEFINE_CODE_IO( 15 )
+DEFINE_CODE_IO( 16 )
+
+#ifdef X86_DECODER
+/**
+ Decode one group of 8 9-bit codes using SSSE3.  Code k starts at bit k
+ of byte k, so a shuffle puts bytes k and k + 1 in 16-bit lane k.
+ Multiplying lane k by 2^(7 - k) shifts out the bits above the code, then
+ shifting every lane right by 7 leaves just the code.
+ @param in the group of bytes to decode, with GROUP_LOAD bytes readable.
+ @param codes array the 8 codes are stored in.
+ */
+__attribute__(( target( "ssse3" ) ))
+static inline void readGroupSsse3( const unsigned char *in, uint16_t *codes )
+{
+    __m128i bytes = _mm_loadu_si128( (const __m128i *)in );
+    __m128i pairs = _mm_shuffle_epi8( bytes, _mm_setr_epi8( 0, 1, 1, 2, 2, 3,
+                                          3, 4, 4, 5, 5, 6, 6, 7, 7, 8 ) );
+    __m128i top = _mm_mullo_epi16( pairs, _mm_setr_epi16( 128, 64, 32, 16,
+                                                          8, 4, 2, 1 ) );
+    _mm_storeu_si128( (__m128i *)codes, _mm_srli_epi16( top, SEVEN ) );
+}
+
+/** readCodes9(), with whole groups decoded by readGroupSsse3().  It's
+    only called on processors that have SSSE3. */
+__attribute__(( target( "ssse3" ) ))
+DEFINE_READ_CODES( readCodes9Ssse3, 9, readGroupSsse3 )
+#endif
+
+/** Bulk writers for each code width, starting from MIN_CODE_BITS. */
+static void ( * const writers[] )( const uint16_t *, size_t, BitWriter * ) = {
+    writeCodes9, writeCodes10, writeCodes11, writeCodes12,
+    writeCodes13, writeCodes14, writeCodes15, writeCodes16
+};
+
+/** Bulk readers for each code width, starting from MIN_CODE_BITS.  The
+    one for 9-bit codes is replaced by chooseReaders() if there's a
+    faster one for this processor. */
+static size_t ( *readers[] )( const unsigned char *, size_t, uint16_t * ) = {
+    readCodes9, readCodes10, readCodes11, readCodes12,
+    readCodes13, readCodes14, readCodes15, readCodes16
+};
+
+/** Pick the fastest reader this processor supports for 9-bit codes.
+ It's run once, when the program or library is loaded, so readCodes()
+ doesn't have to check the processor on every call.
+ */
+__attribute__(( constructor ))
+static void chooseReaders( void )
+{
+#ifdef X86_DECODER
+    __builtin_cpu_init();
+    if ( __builtin_cpu_supports( "ssse3" ) ) {
+        readers[ BITS_PER_CODE - MIN_CODE_BITS ] = readCodes9Ssse3;
+    }
+#endif
+}
+
+/** Add a batch of codes to the output of the given bit writer.
+ @param codes the codes to write, each fitting in the writer's
+ code width.
+ @param n the number of codes.
+ @param writer the bit writer.  Its buffer needs room for
+ CODE_BYTES( n ) more bytes.
+ */
+void writeCodes( const uint16_t *codes, size_t n, BitWriter *writer )
+{
+    writers[ writer->codeBits - MIN_CODE_BITS ]( codes, n, writer );
+}
+
+/** Decode all the complete codes in a block of bytes.
+ @param in the bytes to decode.
+ @param len the number of bytes.
+ @param codeBits number of bits in each code.
+ @param codes array the codes are stored in, with room for
+ len * 8 / codeBits codes.
+ @return the number of codes decoded.
+ */
+size_t readCodes( const unsigned char *in, size_t len, int codeBits,
+                  uint16_t *codes )
+{
+    return readers[ codeBits - MIN_CODE_BITS ]( in, len, codes );
+}
+
+/** Store a number in a buffer, low-order byte first.
+ @param buf where to store it.
+ @param val the number.
+ @param bytes how many bytes to use.
+ */
+void putNumber( unsigned char *buf, uint64_t val, int bytes )
+{
+    for ( int i = 0; i < bytes; i++ ) {
+        buf[ i ] = ( val >> ( i * BITS_PER_BYTE ) ) & 0xFF;
+    }
+}
+
+/** Read a number stored low-order byte first.
+ @param buf where it's stored.
+ @param bytes how many bytes it uses.
+ @return the number.
+ */
+uint64_t getNumber( const unsigned char *buf, int bytes )
+{
+    uint64_t val = 0;
+    for ( int i = 0; i < bytes; i++ ) {
+        val |= (uint64_t)buf[ i ] << ( i * BITS_PER_BYTE );
+    }
+    return val;
+}
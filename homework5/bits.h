@@ -10,14 +10,34 @@
 #define _BITS_H_
 
 #include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
 
 /** Number of bits per byte.  This isn't going to change, but it lets us give
     a good explanation instead of just the literal value, 8. */
 #define BITS_PER_BYTE 8
 
-/** Number of bits in each code written to or read from a file. */
+/** Number of bytes holding a little-endian 16-bit value. */
+#define U16_BYTES 2
+
+/** Number of bytes holding a little-endian 32-bit value. */
+#define U32_BYTES 4
+
+/** Number of bytes holding a little-endian 64-bit value. */
+#define U64_BYTES 8
+
+/** Number of bits in each code written to or read from a file.  This is
+    the width used by writeCode() and readCode(), and by files without
+    a header. */
 #define BITS_PER_CODE 9
 
+/** Narrowest code width the bulk readers and writers support. */
+#define MIN_CODE_BITS 9
+
+/** Widest code width the bulk readers and writers support. */
+#define MAX_CODE_BITS 16
+
 /** Buffer space for up to 8 bits that we're not finished processing.
     We have to read/write files one or more bytes at a time, but we
     need to access this data 9 bits at a time.  While writing a file,
@@ -32,6 +52,40 @@ typedef struct {
   int bitCount;
 } PendingBits;
 
+/** Bit writer that collects codes in a 64-bit register and stores them
+    a whole 32-bit word at a time in a buffer supplied by the caller.
+    For 9-bit codes, the bytes it produces are the same as writeCode()
+    and flushBits() would write for the same codes. */
+typedef struct {
+  /** Number of bits in each code. */
+  int codeBits;
+
+  /** Bits not yet stored in the buffer, in the low-order positions. */
+  uint64_t acc;
+
+  /** Number of bits held in acc. */
+  int bitCount;
+
+  /** Buffer the finished bytes are stored in. */
+  unsigned char *buf;
+
+  /** Number of bytes stored in buf so far. */
+  size_t len;
+} BitWriter;
+
+/** Number of codes in a group.  A group of codes fills a whole number of
+    bytes, one for each bit in a code, so groups start on a byte boundary
+    and can be decoded independently. */
+#define GROUP_CODES BITS_PER_BYTE
+
+/** Number of bytes holding a group of 9-bit codes. */
+#define GROUP_BYTES BITS_PER_CODE
+
+/** Number of bytes writeCodes() may store for a batch of n codes of any
+    width, counting the bits that can be carried over from an earlier
+    batch. */
+#define CODE_BYTES( n ) ( ( n ) * MAX_CODE_BITS / BITS_PER_BYTE + 8 )
+
 /** Write the 9 low-order bits from code to the given file.
     @param code bits to write out, a value betteen 0 and 2^9 - 1.
     @param pending pointer to storage for unwritten bits left over
@@ -51,6 +105,41 @@ void writeCode( int code, PendingBits *pending, FILE *fp );
 */
 void flushBits( PendingBits *pending, FILE *fp );
 
+/** Start a bit writer storing its output in the given buffer.
+    @param writer the bit writer to initialize.
+    @param buf buffer the output is stored in.
+    @param codeBits number of bits in each code, from MIN_CODE_BITS to
+    MAX_CODE_BITS.
+*/
+void initBitWriter( BitWriter *writer, unsigned char *buf, int codeBits );
+
+/** Add a batch of codes to the output of the given bit writer.  Whole
+    32-bit words are stored in the writer's buffer, and any bits left
+    over stay in its register for the next batch.  There's a separate
+    copy of the inner loop for each code width, so the width is only
+    looked at once per batch.
+    @param codes the codes to write, each fitting in the writer's
+    code width.
+    @param n the number of codes.
+    @param writer the bit writer.  Its buffer needs room for
+    CODE_BYTES( n ) more bytes.
+*/
+void writeCodes( const uint16_t *codes, size_t n, BitWriter *writer );
+
+/** Store any bits left in the writer's register, with the last,
+    partial byte padded with zeros in its high-order bits.
+    @param writer the bit writer.
+*/
+void finishCodes( BitWriter *writer );
+
+/** Write out the bytes stored in the writer's buffer, then empty it.
+    Bits still in the register are kept.
+    @param writer the bit writer.
+    @param fp file the bytes are written to, opened for writing.
+    @return false if the bytes couldn't be written.
+*/
+bool drainCodes( BitWriter *writer, FILE *fp );
+
 /** Read and return the next 9-bit code from the given file.
     @param pending pointer to storage for left-over bits read during
     the last call to readCode().
@@ -60,4 +149,34 @@ void flushBits( PendingBits *pending, FILE *fp );
 */
 int readCode( PendingBits *pending, FILE *fp );
 
+/** Decode all the complete codes in a block of bytes read from the start
+    of a compressed stream, or from the start of any later group.  Whole
+    groups of 8 codes are decoded at once, then the codes in any leftover
+    bytes are decoded one at a time.  Like writeCodes(), there's a
+    separate copy of this for each code width.
+    @param in the bytes to decode.
+    @param len the number of bytes.
+    @param codeBits number of bits in each code, from MIN_CODE_BITS to
+    MAX_CODE_BITS.
+    @param codes array the codes are stored in, with room for
+    len * 8 / codeBits codes.
+    @return the number of codes decoded.
+*/
+size_t readCodes( const unsigned char *in, size_t len, int codeBits,
+                  uint16_t *codes );
+
+/** Store a number in a buffer, low-order byte first.
+    @param buf where to store it.
+    @param val the number.
+    @param bytes how many bytes to use.
+*/
+void putNumber( unsigned char *buf, uint64_t val, int bytes );
+
+/** Read a number stored low-order byte first.
+    @param buf where it's stored.
+    @param bytes how many bytes it uses.
+    @return the number.
+*/
+uint64_t getNumber( const unsigned char *buf, int bytes );
+
 #endif
@@ -0,0 +1,419 @@
+/**
+ * @file codec.c
+ * @author Sam Whitlock (sjwhitlo)
+ *
+ * Encodes and decodes whole blocks in memory, and reads and writes
+ * the framing of block-framed files.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+
+#include "codec.h"
+#include "huffman.h"
+
+/** Number of codes encoded or decoded at a time. */
+#define CODE_BATCH 4096
+
+/** Initial capacity of a block index. */
+#define INIT_SIZE 16
+
+/**
+ * Chooses the codes for a sequence of chars that use as few codes as
+ * possible.
+ *
+ * @param wordList A pointer to the wordlist
+ * @param in The chars to encode
+ * @param len The number of chars.  Words won't extend past this.
+ * @param codes Array the codes are stored in, with room for len codes
+ * @return The number of codes stored
+ */
+size_t parseOptimal( WordList *wordList, const char *in, size_t len,
+                     uint16_t *codes )
+{
+    // Fewest codes for the suffix starting at each position, and the
+    // word to start it with
+    int *cost = (int *)malloc((len + 1) * sizeof(int));
+    unsigned char *step = (unsigned char *)malloc(len + 1);
+    uint16_t *choice = (uint16_t *)malloc((len + 1) * sizeof(uint16_t));
+    int matches[WORD_MAX];
+    
+    cost[len] = 0;
+    for (size_t i = len; i-- > 0; ) {
+        // Every char is a word, so there's always at least one match
+        int longest = findMatches(wordList, in + i, len - i < WORD_MAX
+                                  ? len - i : WORD_MAX, matches);
+        cost[i] = INT_MAX;
+        for (int m = longest; m > 0; m--) {
+            if (matches[m - 1] >= 0 && cost[i + m] + 1 < cost[i]) {
+                cost[i] = cost[i + m] + 1;
+                step[i] = m;
+                choice[i] = matches[m - 1];
+            }
+        }
+    }
+    
+    // Follow the choices from the start
+    size_t n = 0;
+    for (size_t i = 0; i < len; i += step[i]) {
+        codes[n++] = choice[i];
+    }
+    
+    free(cost);
+    free(step);
+    free(choice);
+    return n;
+}
+
+/**
+ * Counts a batch of codes, if they're being counted.
+ *
+ * @param uses The counts for each code, or NULL
+ * @param codes The codes
+ * @param n The number of codes
+ */
+static void tallyCodes( uint64_t *uses, const uint16_t *codes, size_t n )
+{
+    if (uses) {
+        for (size_t i = 0; i < n; i++) {
+            uses[codes[i]]++;
+        }
+    }
+}
+
+/**
+ * Encodes a block for a HUFFMAN_VERSION file.  All the codes are chosen
+ * first, so the Huffman code can be built for them, then they're stored
+ * after the block type byte either entropy coded or, if that isn't any
+ * smaller, at their fixed width.
+ *
+ * @param wordList A pointer to the wordlist
+ * @param in The chars to encode, followed by a null terminator
+ * @param len The number of chars
+ * @param optimal True to use parseOptimal()
+ * @param codeBits Number of bits in each code
+ * @param out Buffer for the packed bytes, with room for PACKED_MAX( len )
+ * @param uses Array counting how often each code is used, or NULL
+ * @return The number of bytes stored in out
+ */
+static size_t encodeHuffmanBlock( WordList *wordList, const char *in,
+                                  size_t len, bool optimal, int codeBits,
+                                  unsigned char *out, uint64_t *uses )
+{
+    uint16_t *codes = (uint16_t *)malloc(len * sizeof(uint16_t));
+    size_t n = 0;
+    if (optimal) {
+        n = parseOptimal(wordList, in, len, codes);
+    } else {
+        size_t pos = 0;
+        while (pos < len) {
+            int code = bestCode(wordList, in + pos);
+            codes[n++] = code;
+            pos += wordList->spans[code].length;
+        }
+    }
+    tallyCodes(uses, codes, n);
+    
+    size_t fixed = (n * codeBits + BITS_PER_BYTE - 1) / BITS_PER_BYTE;
+    size_t size = huffmanEncode(codes, n, codeBits, out + 1, fixed);
+    if (size > 0) {
+        out[0] = BLOCK_HUFFMAN;
+    } else {
+        out[0] = BLOCK_FIXED;
+        BitWriter writer;
+        initBitWriter(&writer, out + 1, codeBits);
+        writeCodes(codes, n, &writer);
+        finishCodes(&writer);
+        size = writer.len;
+    }
+    
+    free(codes);
+    return size + 1;
+}
+
+size_t encodeBlock( WordList *wordList, const char *in, size_t len,
+                    bool optimal, int codeBits, bool huffman,
+                    unsigned char *out, uint64_t *uses )
+{
+    if (huffman) {
+        return encodeHuffmanBlock(wordList, in, len, optimal, codeBits, out,
+                                  uses);
+    }
+    
+    BitWriter writer;
+    initBitWriter(&writer, out, codeBits);
+    
+    if (optimal) {
+        uint16_t *codes = (uint16_t *)malloc(len * sizeof(uint16_t));
+        size_t n = parseOptimal(wordList, in, len, codes);
+        tallyCodes(uses, codes, n);
+        writeCodes(codes, n, &writer);
+        free(codes);
+        finishCodes(&writer);
+        return writer.len;
+    }
+    
+    uint16_t codes[CODE_BATCH];
+    int count = 0;
+    
+    // Greedily take the longest word each time, like pack
+    size_t pos = 0;
+    while (pos < len) {
+        int code = bestCode(wordList, in + pos);
+        codes[count++] = code;
+        if (count == CODE_BATCH) {
+            tallyCodes(uses, codes, count);
+            writeCodes(codes, count, &writer);
+            count = 0;
+        }
+        pos += wordList->spans[code].length;
+    }
+    tallyCodes(uses, codes, count);
+    writeCodes(codes, count, &writer);
+    finishCodes(&writer);
+    
+    return writer.len;
+}
+
+/**
+ * Decodes a block of packed bytes, storing the chars in the given buffer.
+ *
+ * @param wordList A pointer to the wordlist
+ * @param in The bytes to decode
+ * @param len The number of bytes
+ * @param codeBits Number of bits in each code
+ * @param out Buffer for the chars
+ * @param cap The size of out
+ * @param uses Array counting how often each code is used, or NULL
+ * @return The number of chars stored in out
+ */
+size_t decodeBlock( WordList *wordList, const unsigned char *in, size_t len,
+                    int codeBits, bool huffman, char *out, size_t cap,
+                    uint64_t *uses )
+{
+    uint16_t codes[CODE_BATCH];
+    size_t total = 0;
+    
+    // Blocks in a HUFFMAN_VERSION file start with their type
+    if (huffman) {
+        if (len == 0) {
+            return 0;
+        }
+        unsigned char type = *in++;
+        len--;
+        if (type == BLOCK_HUFFMAN) {
+            HuffmanDecoder decoder;
+            if (!initHuffmanDecoder(&decoder, in, len, codeBits)) {
+                freeHuffmanDecoder(&decoder);
+                return 0;
+            }
+            size_t n;
+            while ((n = readHuffman(&decoder, codes, CODE_BATCH)) > 0
+                   && copyWords(wordList, codes, n, out, &total, cap)) {
+                tallyCodes(uses, codes, n);
+            }
+            freeHuffmanDecoder(&decoder);
+            return decoder.valid ? total : 0;
+        } else if (type != BLOCK_FIXED) {
+            return 0;
+        }
+    }
+    
+    // Whole groups at a time, so every piece starts at the start of a
+    // group.  A group takes one byte for each bit in a code.
+    size_t step = CODE_BATCH / GROUP_CODES * codeBits;
+    for (size_t pos = 0; pos < len; pos += step) {
+        size_t n = readCodes(in + pos, len - pos < step ? len - pos : step,
+                             codeBits, codes);
+        if (!copyWords(wordList, codes, n, out, &total, cap)) {
+            break;
+        }
+        tallyCodes(uses, codes, n);
+    }
+    
+    return total;
+}
+
+/**
+ * Initializes an empty block index.
+ *
+ * @param index The index
+ * @param blockSize Number of input chars in each block but the last
+ * @param codeBits Number of bits in each code
+ */
+void initBlockIndex( BlockIndex *index, uint32_t blockSize, int codeBits )
+{
+    index->codeBits = codeBits;
+    index->huffman = false;
+    index->blockSize = blockSize;
+    index->count = 0;
+    index->capacity = INIT_SIZE;
+    index->packedOffsets = (uint64_t *)malloc((INIT_SIZE + 1) * sizeof(uint64_t));
+    index->rawOffsets = (uint64_t *)malloc((INIT_SIZE + 1) * sizeof(uint64_t));
+    
+    // The first block comes right after the header
+    index->packedOffsets[0] = HEADER_SIZE;
+    index->rawOffsets[0] = 0;
+}
+
+/**
+ * Adds a block to the end of an index.
+ *
+ * @param index The index
+ * @param rawLen The number of chars the block encodes
+ * @param packedLen The number of bytes in the packed block
+ */
+void addBlock( BlockIndex *index, uint32_t rawLen, uint32_t packedLen )
+{
+    // Resize if needed
+    if (index->count == index->capacity) {
+        index->capacity *= 2;
+        index->packedOffsets = (uint64_t *)realloc(index->packedOffsets,
+                                  (index->capacity + 1) * sizeof(uint64_t));
+        index->rawOffsets = (uint64_t *)realloc(index->rawOffsets,
+                                  (index->capacity + 1) * sizeof(uint64_t));
+    }
+    
+    int i = index->count++;
+    index->packedOffsets[i + 1] = index->packedOffsets[i] + packedLen;
+    index->rawOffsets[i + 1] = index->rawOffsets[i] + rawLen;
+}
+
+/**
+ * Frees the arrays in a block index.
+ *
+ * @param index The index
+ */
+void freeBlockIndex( BlockIndex *index )
+{
+    free(index->packedOffsets);
+    free(index->rawOffsets);
+}
+
+/**
+ * Writes the header of a block-framed file.
+ *
+ * @param fp The file, opened for writing
+ * @param index The index the blocks will be added to, giving the
+ * block size and code width
+ * @return false if it couldn't be written
+ */
+bool writeHeader( FILE *fp, const BlockIndex *index )
+{
+    unsigned char header[HEADER_SIZE] = { 0 };
+    memcpy(header, BLOCK_MAGIC, MAGIC_LEN);
+    header[MAGIC_LEN] = index->huffman ? HUFFMAN_VERSION : FORMAT_VERSION;
+    header[MAGIC_LEN + 1] = index->codeBits;
+    putNumber(header + 2 * MAGIC_LEN, index->blockSize, U32_BYTES);
+    return fwrite(header, 1, HEADER_SIZE, fp) == HEADER_SIZE;
+}
+
+/**
+ * Writes the index and trailer at the end of a block-framed file, after
+ * all the blocks that were added to the index.
+ *
+ * @param fp The file, opened for writing
+ * @param index The index of the blocks
+ * @return false if it couldn't be written
+ */
+bool writeIndex( FILE *fp, const BlockIndex *index )
+{
+    unsigned char entry[INDEX_ENTRY_SIZE];
+    bool ok = true;
+    for (int i = 0; ok && i < index->count; i++) {
+        putNumber(entry, index->rawOffsets[i + 1] - index->rawOffsets[i],
+                  U32_BYTES);
+        putNumber(entry + U32_BYTES,
+                  index->packedOffsets[i + 1] - index->packedOffsets[i],
+                  U32_BYTES);
+        ok = fwrite(entry, 1, INDEX_ENTRY_SIZE, fp) == INDEX_ENTRY_SIZE;
+    }
+    
+    unsigned char trailer[TRAILER_SIZE];
+    putNumber(trailer, index->packedOffsets[index->count], U64_BYTES);
+    putNumber(trailer + U64_BYTES, index->count, U32_BYTES);
+    memcpy(trailer + U64_BYTES + U32_BYTES, INDEX_MAGIC, MAGIC_LEN);
+    return ok && fwrite(trailer, 1, TRAILER_SIZE, fp) == TRAILER_SIZE;
+}
+
+/**
+ * Checks whether a file held in memory has the magic strings of a
+ * block-framed file at its start and end.
+ *
+ * @param data The contents of the file
+ * @param len The size of the file
+ * @return true if it has both magic strings
+ */
+bool hasBlockMagic( const unsigned char *data, size_t len )
+{
+    return len >= HEADER_SIZE + TRAILER_SIZE
+           && memcmp(data, BLOCK_MAGIC, MAGIC_LEN) == 0
+           && memcmp(data + len - MAGIC_LEN, INDEX_MAGIC, MAGIC_LEN) == 0;
+}
+
+/**
+ * Reads the index of a block-framed file held in memory.
+ *
+ * @param data The contents of the file
+ * @param len The size of the file
+ * @param index The index to fill in
+ * @return false if this isn't a valid block-framed file
+ */
+bool readBlockIndex( const unsigned char *data, size_t len, BlockIndex *index )
+{
+    // Check the header and trailer
+    if (!hasBlockMagic(data, len)
+        || (data[MAGIC_LEN] != FORMAT_VERSION
+            && data[MAGIC_LEN] != HUFFMAN_VERSION)
+        || data[MAGIC_LEN + 1] < MIN_CODE_BITS
+        || data[MAGIC_LEN + 1] > MAX_CODE_BITS) {
+        return false;
+    }
+    const unsigned char *trailer = data + len - TRAILER_SIZE;
+    uint64_t indexOffset = getNumber(trailer, U64_BYTES);
+    uint64_t count = getNumber(trailer + U64_BYTES, U32_BYTES);
+    // Bound each part first, so the sum can't wrap around
+    if (indexOffset < HEADER_SIZE || indexOffset > len - TRAILER_SIZE
+        || count > (len - TRAILER_SIZE - indexOffset) / INDEX_ENTRY_SIZE
+        || indexOffset + count * INDEX_ENTRY_SIZE + TRAILER_SIZE != len) {
+        return false;
+    }
+    
+    // Add up the sizes in the index to get the offsets
+    initBlockIndex(index, getNumber(data + 2 * MAGIC_LEN, U32_BYTES),
+                   data[MAGIC_LEN + 1]);
+    index->huffman = data[MAGIC_LEN] == HUFFMAN_VERSION;
+    const unsigned char *entry = data + indexOffset;
+    for (uint64_t i = 0; i < count; i++) {
+        addBlock(index, getNumber(entry, U32_BYTES),
+                 getNumber(entry + U32_BYTES, U32_BYTES));
+        entry += INDEX_ENTRY_SIZE;
+    }
+    
+    // The blocks have to fill the space up to the index exactly, and
+    // every block but the last holds blockSize chars, with the last no
+    // bigger.  Each bit of a block gives at most one word.  A file with
+    // one block could claim any size, so the size is cut down to what
+    // its blocks hold, for sizing buffers by it.
+    bool ok = index->packedOffsets[index->count] == indexOffset
+              && index->blockSize > 0;
+    uint64_t largest = 0;
+    for (int i = 0; ok && i < index->count; i++) {
+        uint64_t rawLen = index->rawOffsets[i + 1] - index->rawOffsets[i];
+        uint64_t packedLen = index->packedOffsets[i + 1] - index->packedOffsets[i];
+        ok = rawLen <= index->blockSize
+             && (i == index->count - 1 || rawLen == index->blockSize)
+             && rawLen <= packedLen * BITS_PER_BYTE * WORD_MAX;
+        largest = rawLen > largest ? rawLen : largest;
+    }
+    if (!ok) {
+        freeBlockIndex(index);
+        return false;
+    }
+    if (index->count > 0) {
+        index->blockSize = largest;
+    }
+    
+    return true;
+}
@@ -0,0 +1,237 @@
+/**
+ * @file codec.h
+ * @author Sam Whitlock (sjwhitlo)
+ *
+ * Header file for codec.c, with functions for encoding and decoding
+ * whole blocks in memory, and for the block-framed file format.
+ *
+ * A block-framed file starts with a HEADER_SIZE byte header: the
+ * BLOCK_MAGIC string, a format version byte, a bits per code byte,
+ * two reserved bytes and the block size.  Then come the independently
+ * encoded blocks, each starting on a byte boundary.  After them is the
+ * block index, with the uncompressed and compressed size of each block,
+ * and finally a TRAILER_SIZE byte trailer: the offset of the index, the
+ * number of blocks and the INDEX_MAGIC string.  All numbers are stored
+ * low-order byte first.
+ *
+ * In a HUFFMAN_VERSION file, each block starts with a byte saying how
+ * its codes are stored: BLOCK_FIXED for fixed-width codes as in other
+ * files, or BLOCK_HUFFMAN for codes entropy coded by huffmanEncode().
+ */
+
+#ifndef _CODEC_H_
+#define _CODEC_H_
+
+#include <stdio.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "wordlist.h"
+#include "bits.h"
+
+/** Magic string at the start of a block-framed file. */
+#define BLOCK_MAGIC "WPAK"
+
+/** Magic string at the end of a block-framed file. */
+#define INDEX_MAGIC "WPIX"
+
+/** Length of the magic strings. */
+#define MAGIC_LEN 4
+
+/** Version of the block-framed format. */
+#define FORMAT_VERSION 1
+
+/** Version of the block-framed format with entropy coded blocks. */
+#define HUFFMAN_VERSION 2
+
+/** Block type for fixed-width codes, in a HUFFMAN_VERSION file. */
+#define BLOCK_FIXED 0
+
+/** Block type for Huffman coded codes, in a HUFFMAN_VERSION file. */
+#define BLOCK_HUFFMAN 1
+
+/** Size of the header at the start of a block-framed file. */
+#define HEADER_SIZE 16
+
+/** Size of each block's entry in the index. */
+#define INDEX_ENTRY_SIZE 8
+
+/** Size of the trailer at the end of a block-framed file. */
+#define TRAILER_SIZE 16
+
+/** Default number of input chars in each block. */
+#define DEFAULT_BLOCK_SIZE ( 1 << 20 )
+
+/** Most input chars pack will put in a block.  Each thread keeps
+    BLOCKS_PER_THREAD blocks and their packed bytes in memory. */
+#define MAX_BLOCK_SIZE ( 1 << 24 )
+
+/** Number of blocks handled in each batch for each thread, when blocks
+    are encoded or decoded in parallel. */
+#define BLOCKS_PER_THREAD 2
+
+/** Most bytes encodeBlock() can produce for len chars of input,
+    counting the block type byte. */
+#define PACKED_MAX( len ) ( CODE_BYTES( len ) + 1 )
+
+/** The index of a block-framed file, giving where each block is
+    stored and where its output goes. */
+typedef struct {
+  /** Number of bits in each code. */
+  int codeBits;
+
+  /** True if blocks can be entropy coded, so each starts with its
+      block type. */
+  bool huffman;
+
+  /** Number of input chars in each block but the last. */
+  uint32_t blockSize;
+
+  /** Number of blocks. */
+  int count;
+
+  /** Capacity of the arrays, so we can know when we need to resize. */
+  int capacity;
+
+  /** Offset in the file of each block, with an extra entry at the end
+      for the offset of the index. */
+  uint64_t *packedOffsets;
+
+  /** Offset in the uncompressed output of each block, with an extra
+      entry at the end for the size of the whole output. */
+  uint64_t *rawOffsets;
+} BlockIndex;
+
+/**
+ * Chooses the codes for a sequence of chars that use as few codes as
+ * possible.  This works backward from the end, finding the fewest codes
+ * needed for each suffix using every word that matches at its start, so
+ * it takes time proportional to len * WORD_MAX.  Where there's a tie,
+ * the longest word is used.
+ *
+ * @param wordList A pointer to the wordlist
+ * @param in The chars to encode
+ * @param len The number of chars.  Words won't extend past this.
+ * @param codes Array the codes are stored in, with room for len codes
+ * @return The number of codes stored
+ */
+size_t parseOptimal( WordList *wordList, const char *in, size_t len,
+                     uint16_t *codes );
+
+/**
+ * Encodes a block of chars, storing the packed bytes in the given
+ * buffer.  The block is encoded on its own, so it ends on a byte
+ * boundary with any unused bits in the last byte set to zero.  With
+ * huffman, the codes are entropy coded as well, unless that wouldn't
+ * make the block any smaller.
+ *
+ * @param wordList A pointer to the wordlist
+ * @param in The chars to encode, followed by a null terminator
+ * @param len The number of chars
+ * @param optimal True to use parseOptimal(), false to take the longest
+ * word each time like pack
+ * @param codeBits Number of bits in each code
+ * @param huffman True for a block in a HUFFMAN_VERSION file
+ * @param out Buffer for the packed bytes, with room for PACKED_MAX( len )
+ * @param uses Array counting how often each code is used, which is
+ * added to, or NULL
+ * @return The number of bytes stored in out
+ */
+size_t encodeBlock( WordList *wordList, const char *in, size_t len,
+                    bool optimal, int codeBits, bool huffman,
+                    unsigned char *out, uint64_t *uses );
+
+/**
+ * Decodes a block of packed bytes, storing the chars in the given buffer.
+ * Nothing is stored past the end of the buffer, so blocks can be decoded
+ * right next to each other.
+ *
+ * @param wordList A pointer to the wordlist
+ * @param in The bytes to decode
+ * @param len The number of bytes
+ * @param codeBits Number of bits in each code
+ * @param huffman True for a block in a HUFFMAN_VERSION file
+ * @param out Buffer for the chars
+ * @param cap The size of out.  If the block decodes to more chars than
+ * this, decoding stops early.
+ * @param uses Array counting how often each code is used, which is
+ * added to, or NULL
+ * @return The number of chars stored in out, which is less than the
+ * size of the block if it isn't valid
+ */
+size_t decodeBlock( WordList *wordList, const unsigned char *in, size_t len,
+                    int codeBits, bool huffman, char *out, size_t cap,
+                    uint64_t *uses );
+
+/**
+ * Initializes an empty block index.
+ *
+ * @param index The index
+ * @param blockSize Number of input chars in each block but the last
+ * @param codeBits Number of bits in each code
+ */
+void initBlockIndex( BlockIndex *index, uint32_t blockSize, int codeBits );
+
+/**
+ * Adds a block to the end of an index.
+ *
+ * @param index The index
+ * @param rawLen The number of chars the block encodes
+ * @param packedLen The number of bytes in the packed block
+ */
+void addBlock( BlockIndex *index, uint32_t rawLen, uint32_t packedLen );
+
+/**
+ * Frees the arrays in a block index.
+ *
+ * @param index The index
+ */
+void freeBlockIndex( BlockIndex *index );
+
+/**
+ * Writes the header of a block-framed file.
+ *
+ * @param fp The file, opened for writing
+ * @param index The index the blocks will be added to, giving the
+ * block size and code width
+ * @return false if it couldn't be written
+ */
+bool writeHeader( FILE *fp, const BlockIndex *index );
+
+/**
+ * Writes the index and trailer at the end of a block-framed file, after
+ * all the blocks that were added to the index.
+ *
+ * @param fp The file, opened for writing
+ * @param index The index of the blocks
+ * @return false if it couldn't be written
+ */
+bool writeIndex( FILE *fp, const BlockIndex *index );
+
+/**
+ * Checks whether a file held in memory has the magic strings of a
+ * block-framed file at its start and end.  A file that has them but
+ * isn't accepted by readBlockIndex() is a damaged block-framed file,
+ * not a stream of codes.
+ *
+ * @param data The contents of the file
+ * @param len The size of the file
+ * @return true if it has both magic strings
+ */
+bool hasBlockMagic( const unsigned char *data, size_t len );
+
+/**
+ * Reads the index of a block-framed file held in memory.  This checks
+ * that the header, index and trailer are consistent with each other
+ * and with the size of the file, and that no block is bigger than the
+ * block size, which is lowered to the biggest block if it's bigger.
+ *
+ * @param data The contents of the file
+ * @param len The size of the file
+ * @param index The index to fill in
+ * @return false if this isn't a valid block-framed file
+ */
+bool readBlockIndex( const unsigned char *data, size_t len, BlockIndex *index );
+
+#endif
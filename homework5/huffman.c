@@ -0,0 +1,466 @@
+/**
+ * @file huffman.c
+ * @author Sam Whitlock (sjwhitlo)
+ *
+ * Canonical Huffman coding of a sequence of codes.  Decoding looks up
+ * the next HUFF_TABLE_BITS bits in a table, which gives one or two codes
+ * at once for all but the rarest ones.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "huffman.h"
+#include "bits.h"
+
+/** Size of the counts at the start of the encoded form. */
+#define HEADER_BYTES ( 2 * U32_BYTES )
+
+/** Size of each code and length pair in the encoded form. */
+#define LENGTH_BYTES ( U16_BYTES + 1 )
+
+/** Number of bits in the decoder's register. */
+#define REGISTER_BITS 64
+
+/** The decoder's register is refilled to hold at least this many bits,
+    enough for any Huffman code. */
+#define REFILL_BITS 56
+
+/** Number of bits stored at a time by the encoder. */
+#define WORD_BITS 32
+
+/** Mask for the bits looked up in a decoding table. */
+#define TABLE_MASK ( ( 1 << HUFF_TABLE_BITS ) - 1 )
+
+/** A code and how often it's used, for building the Huffman code. */
+typedef struct {
+  /** Number of times the code is used. */
+  uint32_t freq;
+
+  /** The code. */
+  uint16_t code;
+} Leaf;
+
+/**
+ * Compares leaves by frequency, then by code.
+ *
+ * @param a A pointer to the first leaf
+ * @param b A pointer to the second leaf
+ * @return neg if a < b, 0 if equal, else pos
+ */
+static int compareLeaves( const void *a, const void *b )
+{
+    const Leaf *la = (const Leaf *)a;
+    const Leaf *lb = (const Leaf *)b;
+    if (la->freq != lb->freq) {
+        return la->freq < lb->freq ? -1 : 1;
+    }
+    return la->code - lb->code;
+}
+
+/**
+ * Reverses the order of the low-order bits of a value, since Huffman
+ * codes are written starting from their high-order bit, but bits go
+ * into the stream low-order bit first.
+ *
+ * @param val The value
+ * @param bits The number of bits to reverse
+ * @return The reversed bits
+ */
+static uint32_t reverseBits( uint32_t val, int bits )
+{
+    uint32_t out = 0;
+    for (int i = 0; i < bits; i++) {
+        out = (out << 1) | ((val >> i) & 1);
+    }
+    return out;
+}
+
+/**
+ * Finds the length of the Huffman code for each leaf.  Since the leaves
+ * are sorted by frequency, the internal nodes are made in order of
+ * frequency too, so the two least frequent nodes are always at the front
+ * of either the leaves or the internal nodes.  Lengths are then limited
+ * to HUFF_MAX_BITS, lengthening the longest codes that are still short
+ * enough until the code is valid again.
+ *
+ * @param leaves The leaves, sorted by frequency
+ * @param m The number of leaves
+ * @param lengths Set to the length for each leaf
+ */
+static void findLengths( const Leaf *leaves, int m, uint8_t *lengths )
+{
+    if (m == 1) {
+        lengths[0] = 1;
+        return;
+    }
+
+    // Nodes 0 to m - 1 are the leaves, the rest internal, with the root last
+    uint64_t *weight = (uint64_t *)malloc((2 * m - 1) * sizeof(uint64_t));
+    int *parent = (int *)malloc((2 * m - 1) * sizeof(int));
+    for (int i = 0; i < m; i++) {
+        weight[i] = leaves[i].freq;
+    }
+    int leaf = 0;
+    int inner = m;
+    for (int next = m; next < 2 * m - 1; next++) {
+        weight[next] = 0;
+        for (int k = 0; k < 2; k++) {
+            int node;
+            if (leaf < m && (inner == next || weight[leaf] <= weight[inner])) {
+                node = leaf++;
+            } else {
+                node = inner++;
+            }
+            weight[next] += weight[node];
+            parent[node] = next;
+        }
+    }
+
+    // Depths, from the root down, reusing weight
+    weight[2 * m - 2] = 0;
+    for (int i = 2 * m - 3; i >= 0; i--) {
+        weight[i] = weight[parent[i]] + 1;
+    }
+
+    // Limit the lengths, then fix the Kraft sum
+    uint64_t kraft = 0;
+    for (int i = 0; i < m; i++) {
+        lengths[i] = weight[i] < HUFF_MAX_BITS ? weight[i] : HUFF_MAX_BITS;
+        kraft += (uint64_t)1 << (HUFF_MAX_BITS - lengths[i]);
+    }
+    while (kraft > (uint64_t)1 << HUFF_MAX_BITS) {
+        int i = 0;
+        while (lengths[i] == HUFF_MAX_BITS) {
+            i++;
+        }
+        lengths[i]++;
+        kraft -= (uint64_t)1 << (HUFF_MAX_BITS - lengths[i]);
+    }
+
+    free(weight);
+    free(parent);
+}
+
+/**
+ * Assigns canonical Huffman codes.  Codes of each length are numbered
+ * in order of value, following on from the codes one bit shorter.
+ *
+ * @param lengths Length of the Huffman code for each code, or 0 if
+ * it isn't used
+ * @param symbols Number of codes
+ * @param count Set to the number of codes with each length
+ * @param first Set to the first Huffman code of each length
+ */
+static void assignCodes( const uint8_t *lengths, int symbols, int *count,
+                         int32_t *first )
+{
+    memset(count, 0, (HUFF_MAX_BITS + 1) * sizeof(int));
+    for (int s = 0; s < symbols; s++) {
+        count[lengths[s]]++;
+    }
+    count[0] = 0;
+
+    int32_t code = 0;
+    first[0] = 0;
+    for (int bits = 1; bits <= HUFF_MAX_BITS; bits++) {
+        code = (code + count[bits - 1]) << 1;
+        first[bits] = code;
+    }
+}
+
+size_t huffmanEncode( const uint16_t *codes, size_t n, int codeBits,
+                      unsigned char *out, size_t limit )
+{
+    int symbols = 1 << codeBits;
+    uint32_t *freq = (uint32_t *)calloc(symbols, sizeof(uint32_t));
+    for (size_t i = 0; i < n; i++) {
+        freq[codes[i]]++;
+    }
+
+    // Find the lengths for the codes that are used
+    Leaf *leaves = (Leaf *)malloc(symbols * sizeof(Leaf));
+    int m = 0;
+    for (int s = 0; s < symbols; s++) {
+        if (freq[s]) {
+            leaves[m].freq = freq[s];
+            leaves[m++].code = s;
+        }
+    }
+    qsort(leaves, m, sizeof(Leaf), compareLeaves);
+    uint8_t *leafLengths = (uint8_t *)malloc(m + 1);
+    uint8_t *lengths = (uint8_t *)calloc(symbols, 1);
+    if (m > 0) {
+        findLengths(leaves, m, leafLengths);
+    }
+
+    // Only go on if it's going to be smaller
+    uint64_t bits = 0;
+    for (int i = 0; i < m; i++) {
+        lengths[leaves[i].code] = leafLengths[i];
+        bits += (uint64_t)leaves[i].freq * leafLengths[i];
+    }
+    size_t size = HEADER_BYTES + (size_t)m * LENGTH_BYTES
+                  + (bits + BITS_PER_BYTE - 1) / BITS_PER_BYTE;
+    free(leaves);
+    free(leafLengths);
+    if (size >= limit) {
+        free(freq);
+        free(lengths);
+        return 0;
+    }
+
+    // The counts and the lengths
+    putNumber(out, n, U32_BYTES);
+    putNumber(out + U32_BYTES, m, U32_BYTES);
+    size_t len = HEADER_BYTES;
+    for (int s = 0; s < symbols; s++) {
+        if (lengths[s]) {
+            putNumber(out + len, s, U16_BYTES);
+            out[len + U16_BYTES] = lengths[s];
+            len += LENGTH_BYTES;
+        }
+    }
+
+    // Work out the Huffman code for each code, reversed for writing
+    int count[HUFF_MAX_BITS + 1];
+    int32_t next[HUFF_MAX_BITS + 1];
+    assignCodes(lengths, symbols, count, next);
+    uint32_t *huff = (uint32_t *)freq;
+    for (int s = 0; s < symbols; s++) {
+        if (lengths[s]) {
+            huff[s] = reverseBits(next[lengths[s]]++, lengths[s]);
+        }
+    }
+
+    // Then the codes themselves, a whole word at a time
+    uint64_t acc = 0;
+    int accBits = 0;
+    for (size_t i = 0; i < n; i++) {
+        acc |= (uint64_t)huff[codes[i]] << accBits;
+        accBits += lengths[codes[i]];
+        if (accBits >= WORD_BITS) {
+            putNumber(out + len, acc, U32_BYTES);
+            len += U32_BYTES;
+            acc >>= WORD_BITS;
+            accBits -= WORD_BITS;
+        }
+    }
+    while (accBits > 0) {
+        out[len++] = acc & 0xFF;
+        acc >>= BITS_PER_BYTE;
+        accBits -= BITS_PER_BYTE;
+    }
+
+    free(freq);
+    free(lengths);
+    return len;
+}
+
+bool initHuffmanDecoder( HuffmanDecoder *decoder, const unsigned char *in,
+                         size_t len, int codeBits )
+{
+    decoder->sorted = NULL;
+    if (len < HEADER_BYTES) {
+        return false;
+    }
+    decoder->remaining = getNumber(in, U32_BYTES);
+    uint64_t m = getNumber(in + U32_BYTES, U32_BYTES);
+    int symbols = 1 << codeBits;
+    if (m > symbols || m * LENGTH_BYTES > len - HEADER_BYTES
+        || (m == 0 && decoder->remaining > 0)) {
+        return false;
+    }
+
+    // Read the lengths, which have to be for increasing codes, and make
+    // a valid prefix code
+    uint8_t *lengths = (uint8_t *)calloc(symbols, 1);
+    uint64_t kraft = 0;
+    int last = -1;
+    const unsigned char *entry = in + HEADER_BYTES;
+    for (uint64_t i = 0; i < m; i++) {
+        int s = getNumber(entry, U16_BYTES);
+        int bits = entry[U16_BYTES];
+        if (s <= last || s >= symbols || bits < 1 || bits > HUFF_MAX_BITS) {
+            free(lengths);
+            return false;
+        }
+        lengths[s] = bits;
+        kraft += (uint64_t)1 << (HUFF_MAX_BITS - bits);
+        last = s;
+        entry += LENGTH_BYTES;
+    }
+    if (kraft > (uint64_t)1 << HUFF_MAX_BITS) {
+        free(lengths);
+        return false;
+    }
+
+    // Codes sorted by length then value, for the long Huffman codes
+    assignCodes(lengths, symbols, decoder->lengthCount, decoder->firstCode);
+    decoder->firstIndex[0] = 0;
+    for (int bits = 1; bits <= HUFF_MAX_BITS; bits++) {
+        decoder->firstIndex[bits] = decoder->firstIndex[bits - 1]
+                                    + decoder->lengthCount[bits - 1];
+    }
+    int place[HUFF_MAX_BITS + 1];
+    memcpy(place, decoder->firstIndex, sizeof(place));
+    decoder->sorted = (uint16_t *)malloc((m + 1) * sizeof(uint16_t));
+
+    // Fill in the table with single codes first.  Entries for bits that
+    // don't start with a short Huffman code are left with no codes.
+    memset(decoder->table, 0, sizeof(decoder->table));
+    int32_t next[HUFF_MAX_BITS + 1];
+    memcpy(next, decoder->firstCode, sizeof(next));
+    for (int s = 0; s < symbols; s++) {
+        int bits = lengths[s];
+        if (!bits) {
+            continue;
+        }
+        decoder->sorted[place[bits]++] = s;
+        uint32_t code = reverseBits(next[bits]++, bits);
+        if (bits <= HUFF_TABLE_BITS) {
+            for (uint32_t k = code; k <= TABLE_MASK; k += 1 << bits) {
+                HuffmanEntry *e = decoder->table + k;
+                e->codes[0] = s;
+                e->count = 1;
+                e->firstBits = bits;
+                e->bits = bits;
+            }
+        }
+    }
+    free(lengths);
+
+    // Then add a second code to entries with room left for one
+    for (int k = 0; k <= TABLE_MASK; k++) {
+        HuffmanEntry *e = decoder->table + k;
+        if (e->count == 1) {
+            const HuffmanEntry *second = decoder->table + (k >> e->firstBits);
+            if (second->count && e->firstBits + second->firstBits
+                <= HUFF_TABLE_BITS) {
+                e->codes[1] = second->codes[0];
+                e->count = 2;
+                e->bits = e->firstBits + second->firstBits;
+            }
+        }
+    }
+
+    // The Huffman codes come after the lengths
+    decoder->in = entry;
+    decoder->len = len - (entry - in);
+    decoder->pos = 0;
+    decoder->bits = 0;
+    decoder->bitCount = 0;
+    decoder->valid = true;
+    return true;
+}
+
+/**
+ * Loads more bits into the decoder's register, so it holds at least
+ * REFILL_BITS unless the input is running out.  Whole bytes are loaded
+ * eight at a time while there are that many left.
+ *
+ * @param decoder The decoder
+ */
+static inline void refill( HuffmanDecoder *decoder )
+{
+    if (decoder->pos + U64_BYTES <= decoder->len) {
+        const unsigned char *p = decoder->in + decoder->pos;
+        uint64_t word = 0;
+        for (int i = 0; i < U64_BYTES; i++) {
+            word |= (uint64_t)p[i] << (i * BITS_PER_BYTE);
+        }
+        decoder->bits |= word << decoder->bitCount;
+        decoder->pos += (REGISTER_BITS - 1 - decoder->bitCount) / BITS_PER_BYTE;
+        decoder->bitCount |= REFILL_BITS;
+    } else {
+        while (decoder->bitCount <= REFILL_BITS && decoder->pos < decoder->len) {
+            decoder->bits |= (uint64_t)decoder->in[decoder->pos++]
+                             << decoder->bitCount;
+            decoder->bitCount += BITS_PER_BYTE;
+        }
+    }
+}
+
+/**
+ * Decodes one Huffman code longer than the table handles, a bit at a
+ * time.
+ *
+ * @param decoder The decoder, with enough bits loaded
+ * @return The code, or -1 if the bits aren't a valid Huffman code
+ */
+static int decodeLong( HuffmanDecoder *decoder )
+{
+    int32_t code = 0;
+    for (int bits = 1; bits <= HUFF_MAX_BITS; bits++) {
+        code = (code << 1) | ((decoder->bits >> (bits - 1)) & 1);
+        int32_t offset = code - decoder->firstCode[bits];
+        if (offset >= 0 && offset < decoder->lengthCount[bits]) {
+            decoder->bits >>= bits;
+            decoder->bitCount -= bits;
+            return decoder->sorted[decoder->firstIndex[bits] + offset];
+        }
+    }
+    return -1;
+}
+
+size_t readHuffman( HuffmanDecoder *decoder, uint16_t *codes, size_t max )
+{
+    size_t n = 0;
+
+    // Take as many codes as each table entry gives while there's room.
+    // Codes are only kept if the bits for them were all there.
+    while (decoder->valid && n + HUFF_ENTRY_CODES <= max
+           && decoder->remaining >= HUFF_ENTRY_CODES) {
+        refill(decoder);
+        const HuffmanEntry *e = decoder->table + (decoder->bits & TABLE_MASK);
+        int count = e->count;
+        if (count) {
+            codes[n] = e->codes[0];
+            codes[n + 1] = e->codes[1];
+            decoder->bits >>= e->bits;
+            decoder->bitCount -= e->bits;
+        } else {
+            int code = decodeLong(decoder);
+            if (code < 0) {
+                decoder->valid = false;
+                break;
+            }
+            codes[n] = code;
+            count = 1;
+        }
+        if (decoder->bitCount < 0) {
+            decoder->valid = false;
+            break;
+        }
+        n += count;
+        decoder->remaining -= count;
+    }
+
+    // Then one at a time up to the end
+    while (decoder->valid && n < max && decoder->remaining > 0) {
+        refill(decoder);
+        const HuffmanEntry *e = decoder->table + (decoder->bits & TABLE_MASK);
+        int code;
+        if (e->count) {
+            code = e->codes[0];
+            decoder->bits >>= e->firstBits;
+            decoder->bitCount -= e->firstBits;
+        } else if ((code = decodeLong(decoder)) < 0) {
+            decoder->valid = false;
+            break;
+        }
+        if (decoder->bitCount < 0) {
+            decoder->valid = false;
+            break;
+        }
+        codes[n++] = code;
+        decoder->remaining--;
+    }
+
+    return n;
+}
+
+void freeHuffmanDecoder( HuffmanDecoder *decoder )
+{
+    free(decoder->sorted);
+}
@@ -0,0 +1,140 @@
+/**
+ * @file huffman.h
+ * @author Sam Whitlock (sjwhitlo)
+ *
+ * Header file for huffman.c, which entropy codes a sequence of codes
+ * with a canonical Huffman code built for it.
+ *
+ * The encoded form starts with the number of codes and the number of
+ * different codes used, as 32-bit numbers, followed by each code used
+ * and the length of its Huffman code, as a 16-bit number and a byte, in
+ * increasing order of code.  Then come the Huffman codes, low-order bit
+ * first like the fixed-width codes, with the last byte padded with zeros.
+ * All numbers are stored low-order byte first.
+ */
+
+#ifndef _HUFFMAN_H_
+#define _HUFFMAN_H_
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/** Longest Huffman code.  Lengths are limited to this so a code always
+    fits in the bits the decoder has loaded. */
+#define HUFF_MAX_BITS 24
+
+/** Number of bits looked up at once in a decoding table. */
+#define HUFF_TABLE_BITS 11
+
+/** Number of codes each decoding table entry can give. */
+#define HUFF_ENTRY_CODES 2
+
+/** Entry of a decoding table, for one value of the next HUFF_TABLE_BITS
+    bits.  If the Huffman codes starting there are short enough, it gives
+    up to HUFF_ENTRY_CODES codes at once. */
+typedef struct {
+  /** The codes. */
+  uint16_t codes[ HUFF_ENTRY_CODES ];
+
+  /** Number of codes, or 0 if the first Huffman code is too long for
+      the table. */
+  uint8_t count;
+
+  /** Bits used by the first code. */
+  uint8_t firstBits;
+
+  /** Bits used by all the codes. */
+  uint8_t bits;
+} HuffmanEntry;
+
+/** State for decoding one encoded sequence of codes. */
+typedef struct {
+  /** The encoded bytes. */
+  const unsigned char *in;
+
+  /** Number of encoded bytes. */
+  size_t len;
+
+  /** Position of the next byte to load. */
+  size_t pos;
+
+  /** Loaded bits, the next one in the low-order position. */
+  uint64_t bits;
+
+  /** Number of loaded bits, which goes negative if the input runs out
+      in the middle of a code. */
+  int bitCount;
+
+  /** Number of codes still to be decoded. */
+  size_t remaining;
+
+  /** False once the encoded bytes turn out not to hold the codes, because
+      they run out too soon or have bits that aren't a Huffman code. */
+  bool valid;
+
+  /** Table for decoding the short Huffman codes. */
+  HuffmanEntry table[ 1 << HUFF_TABLE_BITS ];
+
+  /** Codes sorted by the length of their Huffman code, then by value,
+      for decoding the long Huffman codes. */
+  uint16_t *sorted;
+
+  /** Number of codes with each Huffman code length. */
+  int lengthCount[ HUFF_MAX_BITS + 1 ];
+
+  /** First Huffman code of each length. */
+  int32_t firstCode[ HUFF_MAX_BITS + 1 ];
+
+  /** Position in sorted of the first code of each length. */
+  int firstIndex[ HUFF_MAX_BITS + 1 ];
+} HuffmanDecoder;
+
+/**
+ * Entropy codes a sequence of codes, if that makes it smaller.
+ *
+ * @param codes The codes
+ * @param n The number of codes
+ * @param codeBits Number of bits in each code
+ * @param out Buffer for the encoded bytes
+ * @param limit The size of out.  Nothing is stored unless the encoded
+ * form is smaller than this.
+ * @return The number of bytes stored in out, or 0 if the encoded form
+ * wouldn't be smaller than limit
+ */
+size_t huffmanEncode( const uint16_t *codes, size_t n, int codeBits,
+                      unsigned char *out, size_t limit );
+
+/**
+ * Gets ready to decode an encoded sequence of codes, by reading its
+ * Huffman code lengths and building the decoding table.
+ *
+ * @param decoder The decoder
+ * @param in The encoded bytes
+ * @param len The number of encoded bytes
+ * @param codeBits Number of bits in each code
+ * @return false if the lengths aren't valid
+ */
+bool initHuffmanDecoder( HuffmanDecoder *decoder, const unsigned char *in,
+                         size_t len, int codeBits );
+
+/**
+ * Decodes the next codes in the sequence.
+ *
+ * @param decoder The decoder
+ * @param codes Array the codes are stored in
+ * @param max The most codes to store, at least HUFF_ENTRY_CODES
+ * @return The number of codes stored, which is less than max only at
+ * the end of the sequence, or if the rest of it isn't valid, in which
+ * case valid is cleared
+ */
+size_t readHuffman( HuffmanDecoder *decoder, uint16_t *codes, size_t max );
+
+/**
+ * Frees the memory used by a decoder.
+ *
+ * @param decoder The decoder
+ */
+void freeHuffmanDecoder( HuffmanDecoder *decoder );
+
+#endif
@@ -3,7 +3,41 @@
  * @author Sam Whitlock (sjwhitlo)
  *
  * Takes two (or 3) command line arguments. Reads a file, and converts it
- * to a compressed version based on the wordlist.
+ * to a compressed version based on the wordlist.  Either file name can
+ * be given as "-" to use standard input or standard output, and the input
+ * is encoded as it arrives, so memory use doesn't grow with its size.
+ *
+ * With the --blocks option, the output is a block-framed file instead,
+ * with blocks of --block-size chars, up to MAX_BLOCK_SIZE, encoded in
+ * parallel on --threads threads (by default, one per processor).
+ *
+ * The --width option sets the number of bits in each code, from 9 to 16,
+ * so larger word lists can be used.  The width is recorded in the
+ * header, so this also writes a block-framed file.
+ *
+ * With the --huffman option, the codes in each block are entropy coded
+ * with a Huffman code built for that block, so the most common codes
+ * take fewer bits.  This also writes a block-framed file.
+ *
+ * With the --optimal option, codes are chosen to encode each buffer or
+ * block with as few codes as possible, instead of taking the longest
+ * word each time.  The output can be read by unpack in the same way.
+ *
+ * With the --pipeline option, a stream is read, encoded and written on
+ * three separate threads, so the disk and the encoder don't wait on
+ * each other.  The output is the same either way.
+ *
+ * With --stats, or --stats-json for the same thing as JSON, statistics
+ * on the codes written and the time taken are printed to standard error.
+ *
+ * With the --batch option, the file names come from a batch list
+ * instead, one pair to a line, and the word list is loaded only once.
+ * Files are compressed in parallel on --threads threads, and a failure
+ * is reported for just the file it happened in.
+ *
+ * With --sync-index, a stream also gets a sidecar index with a sync
+ * point every --sync-every codes, so unpack --range can read any part
+ * of it without decoding everything before.
  */
 
 #include <stdio.h>
@@ -13,22 +47,77 @@
 
 #include "wordlist.h"
 #include "bits.h"
+#include "codec.h"
+#include "pool.h"
+#include "pipeline.h"
+#include "batch.h"
+#include "stats.h"
+#include "syncindex.h"
 
 /** Usage message. */
 #define USAGE "usage: pack <input.txt> <compressed.raw> [word_file.txt]"
+/** Usage message for a batch, which only writes files without blocks. */
+#define BATCH_USAGE "usage: pack --batch <list.txt> [--optimal] [word_file.txt]"
 /** Can't open file. */
 #define FILE_ERROR "Can't open file: %s\n"
 /** Invalid word file. */
 #define INVAL_WORD_FILE "Invalid word file"
+/** Error writing the output. */
+#define WRITE_ERROR "Can't write output"
+/** Error for running out of memory. */
+#define MEMORY_ERROR "Out of memory"
 /** Invalid char code. */
 #define CHAR_CODE "Invalid character code: %x"
 /** Expected number of command line arguments. */
 #define CMD_ARGS 3
-/** Initial size. */
-#define INIT_SIZE 5
+/** Capacity of the input buffer.  This has to be much larger than
+    WORD_MAX, so a refill leaves room for a full word of lookahead. */
+#define BUFFER_SIZE 65536
+/** Number of codes collected before they're handed to the bit writer. */
+#define CODE_BATCH 4096
+/** Option for writing a block-framed file. */
+#define BLOCKS_OPT "--blocks"
+/** Option for choosing codes with parseOptimal(). */
+#define OPTIMAL_OPT "--optimal"
+/** Option for entropy coding the codes in each block. */
+#define HUFFMAN_OPT "--huffman"
+/** Option for the number of bits per code, followed by the number. */
+#define WIDTH_OPT "--width"
+/** Option for encoding a stream on its own thread. */
+#define PIPELINE_OPT "--pipeline"
+/** Option for compressing the files in a batch list, followed by its name. */
+#define BATCH_OPT "--batch"
+/** Can't open file, for a file in a batch. */
+#define BATCH_FILE_ERROR "Can't open file: %s"
+/** Can't write file, for a file in a batch. */
+#define BATCH_WRITE_ERROR "Can't write file: %s"
+/** Invalid batch list. */
+#define INVAL_BATCH "Invalid batch list"
+/** Option for printing statistics. */
+#define STATS_OPT "--stats"
+/** Option for printing statistics as JSON. */
+#define STATS_JSON_OPT "--stats-json"
+/** Option for the number of threads, followed by the number. */
+#define THREADS_OPT "--threads"
+/** Option for the number of chars in each block, followed by the number. */
+#define BLOCK_SIZE_OPT "--block-size"
+/** Option for writing a sync index, followed by its file name. */
+#define SYNC_INDEX_OPT "--sync-index"
+/** Option for the number of codes between sync points, followed by it. */
+#define SYNC_EVERY_OPT "--sync-every"
+/** Error for a sync index asked for with a block-framed file. */
+#define SYNC_ERROR "Sync indexes are only for streams"
+/** File name standing for standard input or standard output. */
+#define STD_STREAM "-"
 /** Size of an error char string. */
 #define ECHAR 30
 
+/** Statistics being kept, or NULL if they weren't asked for. */
+static Stats *stats = NULL;
+
+/** Sync index being built for the stream, or NULL if it wasn't asked for. */
+static SyncIndex *syncIndex = NULL;
+
 /**
  * Prints an error message passed in as a paramater.
  *
@@ -41,42 +130,563 @@ void error(char *message)
 }
 
 /**
- * Reads in a file passed in as a parameter. Returns a pointer to
- * the buffer.
+ * Opens the named file, or returns stdin or stdout for "-".  Prints
+ * an error and exits if the file can't be opened.
+ *
+ * @param fname The name of the file
+ * @param mode The mode to open it with
+ * @param std The stream to use for "-"
+ * @return The opened file
+ */
+FILE *openFile(char *fname, char *mode, FILE *std)
+{
+    if (strcmp(fname, STD_STREAM) == 0) {
+        return std;
+    }
+    FILE *fp = fopen(fname, mode);
+    if (!fp) {
+        fprintf(stderr, FILE_ERROR, fname);
+        error(USAGE);
+    }
+    return fp;
+}
+
+/**
+ * Checks that every char in a buffer is valid.  Prints an error and
+ * exits if there's an invalid one.
  *
- * @param fp A pointer to the file
- * @return The buffered string
+ * @param buffer The chars to check
+ * @param len The number of chars
  */
-char *readFile(FILE *fp)
+void checkChars(const char *buffer, int len)
 {
-    // Allocate a string with a small, initial capacity.
-    int capacity = INIT_SIZE;
-    char *buffer = malloc( capacity * sizeof(char) );
+    size_t bad = findInvalidChar(buffer, len);
+    if (bad < len) {
+        char invalChar[ECHAR];
+        sprintf(invalChar, CHAR_CODE, buffer[bad] & 0xFF);
+        error(invalChar);
+    }
+}
+
+/**
+ * Slides the unencoded tail of the buffer to the front, then reads
+ * more of the file in after it.  Exits if an invalid character is read.
+ * The buffer is kept null terminated.
+ *
+ * @param fp The file being read
+ * @param buffer The input buffer, with room for BUFFER_SIZE chars
+ * and a null terminator
+ * @param pos Pointer to the position of the next char to encode,
+ * reset to zero
+ * @param len Pointer to the number of chars in the buffer
+ * @return false once the end of the file has been reached
+ */
+bool fillBuffer(FILE *fp, char *buffer, int *pos, int *len)
+{
+    // Keep the chars we haven't encoded yet
+    *len -= *pos;
+    memmove(buffer, buffer + *pos, *len);
+    *pos = 0;
+    
+    // Read as much as fits
+    int count = fread(buffer + *len, 1, BUFFER_SIZE - *len, fp);
+    checkChars(buffer + *len, count);
+    *len += count;
+    buffer[*len] = '\0';
     
-    // Number of characters we're currently using.
+    return count > 0;
+}
+
+/**
+ * Packs a batch of codes and writes them out, timing each step.
+ *
+ * @param codes The codes
+ * @param count The number of codes
+ * @param last True for the last batch, to write out the last partial byte
+ * @param writer The bit writer
+ * @param output The file to write the codes to
+ * @param clock The stopwatch, started when the codes started being chosen
+ * @return The stopwatch, restarted
+ */
+double emitCodes(const uint16_t *codes, size_t count, bool last,
+                 BitWriter *writer, FILE *output, double clock)
+{
+    clock = lapStats(stats, PHASE_WORDS, clock);
+    countCodes(stats, codes, count);
+    addSyncCodes(syncIndex, codes, count);
+    writeCodes(codes, count, writer);
+    if (last) {
+        finishCodes(writer);
+    }
+    clock = lapStats(stats, PHASE_BITS, clock);
+    addBytes(stats, 0, writer->len);
+    if (!drainCodes(writer, output)) {
+        error(WRITE_ERROR);
+    }
+    return lapStats(stats, PHASE_OUTPUT, clock);
+}
+
+/**
+ * Compresses the input to the output as one continuous stream of codes.
+ *
+ * @param wordList A pointer to the wordlist
+ * @param input The file to compress
+ * @param output The file to write the codes to
+ */
+void packStream(WordList *wordList, FILE *input, FILE *output)
+{
+    // Work through the input one buffer at a time, refilling it whenever
+    // fewer than WORD_MAX chars are left to look ahead at.
+    char *buffer = (char *)malloc(BUFFER_SIZE + 1);
+    int pos = 0;
     int len = 0;
+    bool more = true;
     
-    // Add chars to the end of the buffer.
-    char in;
-    while (fscanf(fp, "%c", &in) == 1 && in != EOF) {
-        // Invalid chars
-        if (!validChar(in)) {
-            char invalChar[ECHAR];
-            sprintf(invalChar, CHAR_CODE, in & 0xFF);
-            error(invalChar);
+    // Codes are collected in batches, then packed into the output buffer.
+    uint16_t codes[ CODE_BATCH ];
+    int count = 0;
+    unsigned char *packed = (unsigned char *)malloc( CODE_BYTES( CODE_BATCH ) );
+    BitWriter writer;
+    initBitWriter( &writer, packed, BITS_PER_CODE );
+    double clock = statsClock( stats );
+    
+    while ( true ) {
+        if ( more && len - pos < WORD_MAX ) {
+            clock = lapStats( stats, PHASE_WORDS, clock );
+            int held = len - pos;
+            more = fillBuffer( input, buffer, &pos, &len );
+            addBytes( stats, len - held, 0 );
+            clock = lapStats( stats, PHASE_INPUT, clock );
+        }
+        if ( pos == len ) {
+            break;
         }
         
-        // If going to write outside of bounds
-        if (len == capacity - 2) {
-            capacity *= 2;
-            buffer = (char *)realloc(buffer, capacity * sizeof(char));
+        // Get the next code.
+        int code = bestCode( wordList, buffer + pos );
+#ifdef DEBUG
+        printf( "%d <- %.*s\n", code, wordList->spans[ code ].length,
+                wordList->pool + wordList->spans[ code ].offset );
+#endif
+        // Write it out and move ahead by the number of characters we just encoded.
+        codes[ count++ ] = code;
+        if ( count == CODE_BATCH ) {
+            clock = emitCodes( codes, count, false, &writer, output, clock );
+            count = 0;
+        }
+        pos += wordList->spans[ code ].length;
+    }
+    
+    // Write out the last batch, and any remaining bits in the last, partial byte.
+    emitCodes( codes, count, true, &writer, output, clock );
+    
+    free(buffer);
+    free(packed);
+}
+
+/**
+ * Compresses the input to the output as one continuous stream of codes,
+ * using the fewest codes for each buffer full of input.
+ *
+ * @param wordList A pointer to the wordlist
+ * @param input The file to compress
+ * @param output The file to write the codes to
+ */
+void packStreamOptimal(WordList *wordList, FILE *input, FILE *output)
+{
+    char *buffer = (char *)malloc(BUFFER_SIZE + 1);
+    int pos = 0;
+    int len = 0;
+    
+    // There's at most one code per char
+    uint16_t *codes = (uint16_t *)malloc(BUFFER_SIZE * sizeof(uint16_t));
+    unsigned char *packed = (unsigned char *)malloc(CODE_BYTES(BUFFER_SIZE));
+    BitWriter writer;
+    initBitWriter(&writer, packed, BITS_PER_CODE);
+    
+    // Encode everything in the buffer each time it's filled
+    double clock = statsClock(stats);
+    while (fillBuffer(input, buffer, &pos, &len)) {
+        addBytes(stats, len, 0);
+        clock = lapStats(stats, PHASE_INPUT, clock);
+        size_t n = parseOptimal(wordList, buffer, len, codes);
+        clock = emitCodes(codes, n, false, &writer, output, clock);
+        pos = len;
+    }
+    clock = lapStats(stats, PHASE_INPUT, clock);
+    emitCodes(codes, 0, true, &writer, output, clock);
+    
+    free(buffer);
+    free(codes);
+    free(packed);
+}
+
+/** State of the encoding stage of a pipeline. */
+typedef struct {
+  /** The wordlist used for encoding. */
+  WordList *wordList;
+
+  /** True to choose codes with parseOptimal(). */
+  bool optimal;
+
+  /** Chars held back from the last buffer, followed by the new ones,
+      null terminated. */
+  char *buffer;
+
+  /** Number of chars held back. */
+  int held;
+
+  /** Codes for one buffer. */
+  uint16_t *codes;
+
+  /** Bit writer, which keeps the bits of a partial word from one
+      buffer to the next. */
+  BitWriter writer;
+} StreamEncoder;
+
+/**
+ * Encodes a buffer of the input, as packStream() or packStreamOptimal()
+ * would.  Without --optimal, the last WORD_MAX or so chars are held back
+ * until the next buffer, so bestCode() always sees a full word ahead.
+ *
+ * @param arg The StreamEncoder
+ * @param in The chars read
+ * @param len The number of chars
+ * @param last True for the end of the input
+ * @param out Buffer for the packed bytes
+ * @return The number of bytes stored in out
+ */
+size_t encodeStage(void *arg, const unsigned char *in, size_t len, bool last,
+                   unsigned char *out)
+{
+    StreamEncoder *enc = (StreamEncoder *)arg;
+    checkChars((const char *)in, len);
+    enc->writer.buf = out;
+    enc->writer.len = 0;
+    double clock = statsClock(stats);
+    
+    size_t count = 0;
+    if (enc->optimal) {
+        count = parseOptimal(enc->wordList, (const char *)in, len, enc->codes);
+    } else {
+        memcpy(enc->buffer + enc->held, in, len);
+        int total = enc->held + len;
+        enc->buffer[total] = '\0';
+        
+        // Take words while there's a full word of lookahead
+        int pos = 0;
+        while (pos < total && (last || total - pos >= WORD_MAX)) {
+            int code = bestCode(enc->wordList, enc->buffer + pos);
+            enc->codes[count++] = code;
+            pos += enc->wordList->spans[code].length;
         }
-        buffer[len++] = in;
-        buffer[len + 1] = '\0';
+        enc->held = total - pos;
+        memmove(enc->buffer, enc->buffer + pos, enc->held);
     }
+    clock = lapStats(stats, PHASE_WORDS, clock);
     
-    // Return the buffer
-    return buffer;
+    countCodes(stats, enc->codes, count);
+    addSyncCodes(syncIndex, enc->codes, count);
+    writeCodes(enc->codes, count, &enc->writer);
+    if (last) {
+        finishCodes(&enc->writer);
+    }
+    lapStats(stats, PHASE_BITS, clock);
+    addBytes(stats, len, enc->writer.len);
+    return enc->writer.len;
+}
+
+/**
+ * Compresses the input to the output as one continuous stream of codes,
+ * reading, encoding and writing on separate threads.
+ *
+ * @param wordList A pointer to the wordlist
+ * @param input The file to compress
+ * @param output The file to write the codes to
+ * @param optimal True to choose codes with parseOptimal()
+ */
+void packPipelined(WordList *wordList, FILE *input, FILE *output, bool optimal)
+{
+    StreamEncoder enc;
+    enc.wordList = wordList;
+    enc.optimal = optimal;
+    enc.buffer = (char *)malloc(BUFFER_SIZE + WORD_MAX + 1);
+    enc.held = 0;
+    enc.codes = (uint16_t *)malloc((BUFFER_SIZE + WORD_MAX) * sizeof(uint16_t));
+    initBitWriter(&enc.writer, NULL, BITS_PER_CODE);
+    
+    if (!runPipeline(input, NULL, 0, output, BUFFER_SIZE,
+                     CODE_BYTES(BUFFER_SIZE + WORD_MAX), encodeStage, &enc, stats)) {
+        error(WRITE_ERROR);
+    }
+    
+    free(enc.buffer);
+    free(enc.codes);
+}
+
+/** A batch of blocks being encoded in parallel. */
+typedef struct {
+  /** The wordlist used for encoding. */
+  WordList *wordList;
+
+  /** True to choose codes with parseOptimal(). */
+  bool optimal;
+
+  /** Number of bits in each code. */
+  int codeBits;
+
+  /** True to entropy code the blocks. */
+  bool huffman;
+
+  /** Input chars for each block, null terminated. */
+  char **blocks;
+
+  /** Number of input chars in each block. */
+  size_t *rawLens;
+
+  /** Packed bytes for each block. */
+  unsigned char **packed;
+
+  /** Number of packed bytes for each block. */
+  size_t *packedLens;
+
+  /** Number of times each code was used in each block, or NULL if
+      statistics aren't being kept. */
+  uint64_t **uses;
+} BlockBatch;
+
+/**
+ * Encodes one block of a batch.
+ *
+ * @param arg The batch
+ * @param job The number of the block
+ */
+void encodeJob(void *arg, int job)
+{
+    BlockBatch *batch = (BlockBatch *)arg;
+    batch->packedLens[job] = encodeBlock(batch->wordList, batch->blocks[job],
+                                         batch->rawLens[job], batch->optimal,
+                                         batch->codeBits, batch->huffman,
+                                         batch->packed[job],
+                                         batch->uses ? batch->uses[job] : NULL);
+}
+
+/**
+ * Compresses the input to the output as a block-framed file.  Blocks
+ * are read in batches with a few for each thread, then encoded in
+ * parallel and written out in order.
+ *
+ * @param wordList A pointer to the wordlist
+ * @param input The file to compress
+ * @param output The file to write to
+ * @param threads The number of threads to encode with
+ * @param blockSize The number of chars in each block
+ * @param optimal True to choose codes with parseOptimal()
+ * @param codeBits Number of bits in each code
+ * @param huffman True to entropy code the blocks
+ */
+void packBlocks(WordList *wordList, FILE *input, FILE *output, int threads,
+                int blockSize, bool optimal, int codeBits, bool huffman)
+{
+    ThreadPool *pool = makeThreadPool(threads);
+    
+    // Buffers for a batch of blocks
+    int batchSize = threads * BLOCKS_PER_THREAD;
+    BlockBatch batch;
+    batch.wordList = wordList;
+    batch.optimal = optimal;
+    batch.codeBits = codeBits;
+    batch.huffman = huffman;
+    batch.blocks = (char **)malloc(batchSize * sizeof(char *));
+    batch.rawLens = (size_t *)malloc(batchSize * sizeof(size_t));
+    batch.packed = (unsigned char **)malloc(batchSize * sizeof(unsigned char *));
+    batch.packedLens = (size_t *)malloc(batchSize * sizeof(size_t));
+    batch.uses = NULL;
+    if (stats) {
+        batch.uses = (uint64_t **)malloc(batchSize * sizeof(uint64_t *));
+    }
+    if (!batch.blocks || !batch.rawLens || !batch.packed || !batch.packedLens
+        || (stats && !batch.uses)) {
+        error(MEMORY_ERROR);
+    }
+    for (int i = 0; i < batchSize; i++) {
+        batch.blocks[i] = (char *)malloc((size_t)blockSize + 1);
+        batch.packed[i] = (unsigned char *)malloc(PACKED_MAX((size_t)blockSize));
+        if (!batch.blocks[i] || !batch.packed[i]) {
+            error(MEMORY_ERROR);
+        }
+        if (stats) {
+            batch.uses[i] = (uint64_t *)calloc(1 << codeBits, sizeof(uint64_t));
+            if (!batch.uses[i]) {
+                error(MEMORY_ERROR);
+            }
+        }
+    }
+    
+    BlockIndex index;
+    initBlockIndex(&index, blockSize, codeBits);
+    index.huffman = huffman;
+    if (!writeHeader(output, &index)) {
+        error(WRITE_ERROR);
+    }
+    double clock = statsClock(stats);
+    
+    bool more = true;
+    while (more) {
+        // Read in a batch, stopping at the end of the input
+        int count = 0;
+        while (more && count < batchSize) {
+            size_t len = fread(batch.blocks[count], 1, blockSize, input);
+            if (len < blockSize) {
+                more = false;
+            }
+            if (len > 0) {
+                checkChars(batch.blocks[count], len);
+                batch.blocks[count][len] = '\0';
+                batch.rawLens[count++] = len;
+                addBytes(stats, len, 0);
+            }
+        }
+        clock = lapStats(stats, PHASE_INPUT, clock);
+        
+        // Encode them all, then write them out in order.  Choosing the
+        // words and packing them happen together in the workers, so
+        // it's all counted as choosing words.
+        runJobs(pool, encodeJob, &batch, count);
+        clock = lapStats(stats, PHASE_WORDS, clock);
+        for (int i = 0; i < count; i++) {
+            if (stats) {
+                mergeUses(stats, batch.uses[i], 1 << codeBits);
+            }
+            if (fwrite(batch.packed[i], 1, batch.packedLens[i], output)
+                != batch.packedLens[i]) {
+                error(WRITE_ERROR);
+            }
+            addBlock(&index, batch.rawLens[i], batch.packedLens[i]);
+        }
+        clock = lapStats(stats, PHASE_OUTPUT, clock);
+    }
+    if (!writeIndex(output, &index)) {
+        error(WRITE_ERROR);
+    }
+    addBytes(stats, 0, index.packedOffsets[index.count]
+             + index.count * INDEX_ENTRY_SIZE + TRAILER_SIZE);
+    
+    // Free memory
+    freeThreadPool(pool);
+    freeBlockIndex(&index);
+    for (int i = 0; i < batchSize; i++) {
+        free(batch.blocks[i]);
+        free(batch.packed[i]);
+        if (stats) {
+            free(batch.uses[i]);
+        }
+    }
+    free(batch.uses);
+    free(batch.blocks);
+    free(batch.rawLens);
+    free(batch.packed);
+    free(batch.packedLens);
+}
+
+/** A batch of files being compressed in parallel. */
+typedef struct {
+  /** The wordlist used for encoding. */
+  WordList *wordList;
+
+  /** True to choose codes with parseOptimal(). */
+  bool optimal;
+
+  /** The files. */
+  BatchFile *files;
+} FileBatch;
+
+/**
+ * Compresses one file of a batch, as packStream() or packStreamOptimal()
+ * would, recording what went wrong instead of exiting.  Batches are
+ * for lots of small files, so each is read in whole.
+ *
+ * @param arg The batch
+ * @param job The number of the file
+ */
+void packFileJob(void *arg, int job)
+{
+    FileBatch *batch = (FileBatch *)arg;
+    BatchFile *file = batch->files + job;
+    
+    size_t len;
+    char *text = readWholeFile(file->input, &len);
+    if (!text) {
+        snprintf(file->message, BATCH_MESSAGE, BATCH_FILE_ERROR, file->input);
+        return;
+    }
+    size_t bad = findInvalidChar(text, len);
+    if (bad < len) {
+        snprintf(file->message, BATCH_MESSAGE, CHAR_CODE, text[bad] & 0xFF);
+        free(text);
+        return;
+    }
+    
+    // Choose all the codes.  Optimal parsing works on the same buffer
+    // sized pieces the stream would be read in.
+    uint16_t *codes = (uint16_t *)malloc((len + 1) * sizeof(uint16_t));
+    size_t n = 0;
+    if (batch->optimal) {
+        for (size_t pos = 0; pos < len; pos += BUFFER_SIZE) {
+            n += parseOptimal(batch->wordList, text + pos, len - pos < BUFFER_SIZE
+                              ? len - pos : BUFFER_SIZE, codes + n);
+        }
+    } else {
+        for (size_t pos = 0; pos < len; ) {
+            int code = bestCode(batch->wordList, text + pos);
+            codes[n++] = code;
+            pos += batch->wordList->spans[code].length;
+        }
+    }
+    
+    unsigned char *packed = (unsigned char *)malloc(CODE_BYTES(n));
+    BitWriter writer;
+    initBitWriter(&writer, packed, BITS_PER_CODE);
+    writeCodes(codes, n, &writer);
+    finishCodes(&writer);
+    if (writeWholeFile(file->output, packed, writer.len)) {
+        file->ok = true;
+    } else {
+        snprintf(file->message, BATCH_MESSAGE, BATCH_WRITE_ERROR, file->output);
+    }
+    
+    free(text);
+    free(codes);
+    free(packed);
+}
+
+/**
+ * Compresses every file in a batch list.
+ *
+ * @param wordList A pointer to the wordlist
+ * @param list The name of the batch list
+ * @param threads The number of threads to compress with
+ * @param optimal True to choose codes with parseOptimal()
+ * @return The number of files that failed
+ */
+int packBatch(WordList *wordList, char *list, int threads, bool optimal)
+{
+    FileBatch batch;
+    int count;
+    batch.files = readBatchList(list, &count);
+    if (!batch.files) {
+        error(INVAL_BATCH);
+    }
+    batch.wordList = wordList;
+    batch.optimal = optimal;
+    
+    ThreadPool *pool = makeThreadPool(threads);
+    runJobs(pool, packFileJob, &batch, count);
+    freeThreadPool(pool);
+    
+    int failed = reportBatch(batch.files, count);
+    freeBatchList(batch.files, count);
+    return failed;
 }
 
 /**
@@ -90,6 +700,82 @@ int main( int argc, char *argv[] )
 {
     char *wordFile = "words.txt";
     
+    // Pull out any options, leaving just the file names
+    bool blocks = false;
+    bool optimal = false;
+    bool huffman = false;
+    bool pipeline = false;
+    char *batchList = NULL;
+    bool showStats = false;
+    bool json = false;
+    int codeBits = BITS_PER_CODE;
+    int threads = processorCount();
+    int blockSize = DEFAULT_BLOCK_SIZE;
+    char *syncFile = NULL;
+    int syncEvery = SYNC_INTERVAL;
+    int count = 1;
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], BLOCKS_OPT) == 0) {
+            blocks = true;
+        } else if (strcmp(argv[i], OPTIMAL_OPT) == 0) {
+            optimal = true;
+        } else if (strcmp(argv[i], PIPELINE_OPT) == 0) {
+            pipeline = true;
+        } else if (strcmp(argv[i], STATS_OPT) == 0) {
+            showStats = true;
+        } else if (strcmp(argv[i], STATS_JSON_OPT) == 0) {
+            showStats = true;
+            json = true;
+        } else if (strcmp(argv[i], BATCH_OPT) == 0) {
+            if (i + 1 == argc) {
+                error(USAGE);
+            }
+            batchList = argv[++i];
+        } else if (strcmp(argv[i], HUFFMAN_OPT) == 0) {
+            huffman = true;
+            blocks = true;
+        } else if (strcmp(argv[i], THREADS_OPT) == 0) {
+            if (i + 1 == argc || (threads = atoi(argv[++i])) < 1) {
+                error(USAGE);
+            }
+        } else if (strcmp(argv[i], WIDTH_OPT) == 0) {
+            if (i + 1 == argc || (codeBits = atoi(argv[++i])) < MIN_CODE_BITS
+                || codeBits > MAX_CODE_BITS) {
+                error(USAGE);
+            }
+            blocks = true;
+        } else if (strcmp(argv[i], BLOCK_SIZE_OPT) == 0) {
+            if (i + 1 == argc || (blockSize = atoi(argv[++i])) < 1
+                || blockSize > MAX_BLOCK_SIZE) {
+                error(USAGE);
+            }
+        } else if (strcmp(argv[i], SYNC_INDEX_OPT) == 0) {
+            if (i + 1 == argc) {
+                error(USAGE);
+            }
+            syncFile = argv[++i];
+        } else if (strcmp(argv[i], SYNC_EVERY_OPT) == 0) {
+            if (i + 1 == argc || (syncEvery = atoi(argv[++i])) < 1) {
+                error(USAGE);
+            }
+        } else {
+            argv[count++] = argv[i];
+        }
+    }
+    argc = count;
+    
+    // A batch has the file names in its list, so there's at most a word file
+    if (batchList) {
+        if (blocks || pipeline || showStats || syncFile || argc > 2) {
+            error(BATCH_USAGE);
+        }
+        WordList *wordList = readWordList(argc == 2 ? argv[1] : wordFile,
+                                          1 << BITS_PER_CODE);
+        int failed = packBatch(wordList, batchList, threads, optimal);
+        freeWordList(wordList);
+        return failed ? EXIT_FAILURE : EXIT_SUCCESS;
+    }
+    
     // If args are not correct
     if (argc != CMD_ARGS && argc != (CMD_ARGS + 1)) {
         error(USAGE);
@@ -99,59 +785,67 @@ int main( int argc, char *argv[] )
         wordFile = argv[CMD_ARGS];
     }
     
+    if (blocks && syncFile) {
+        error(SYNC_ERROR);
+    }
+    
     // Check for errors in the wordlist before in the files
-    WordList *wordList = readWordList( wordFile );
+    WordList *wordList = readWordList( wordFile, 1 << codeBits );
     
     // Read in filenames
-    FILE *input = fopen(argv[1], "r");
-    FILE *output = fopen(argv[2], "wb");
-    
-    // Errors for not able to open file
-    if (!input) {
-        fprintf(stderr, FILE_ERROR, argv[1]);
-        error(USAGE);
-    }
-    if (!output) {
-        fprintf(stderr, FILE_ERROR, argv[2]);
-        error(USAGE);
-    }
+    FILE *input = openFile(argv[1], "r", stdin);
+    FILE *output = openFile(argv[2], "wb", stdout);
     
 #ifdef DEBUG
     // Report the entire contents of the word list, once it's built.
     printf( "---- word list -----\n" );
     for ( int i = 0; i < wordList->len; i++ )
-        printf( "%d == %s\n", i, wordList->words[ i ] );
+        printf( "%d == %.*s\n", i, wordList->spans[ i ].length,
+                wordList->pool + wordList->spans[ i ].offset );
     printf( "--------------------\n" );
 #endif
-    // Read the contents of the whole file into one big buffer.  This could be more
-    // efficient, but it simplifies the rest of the program.
-    char *buffer = readFile( input );
-    
-    // Write out codes for everything in the buffer.
-    int pos = 0;
-    PendingBits pending = { 0, 0 };
+    Stats runStats;
+    if (showStats) {
+        initStats(&runStats);
+        stats = &runStats;
+    }
+    SyncIndex runIndex;
+    if (syncFile) {
+        initSyncIndex(&runIndex, wordList, syncEvery);
+        syncIndex = &runIndex;
+    }
     
-    while ( buffer[ pos ] ) {
-        // Get the next code.
-        int code = bestCode( wordList, buffer + pos );
-#ifdef DEBUG
-        printf( "%d <- %s\n", code, wordList->words[ code ] );
-#endif
-        // Write it out and move ahead by the number of characters we just encoded.
-        writeCode( code, &pending, output );
-        pos += strlen( wordList->words[ code ] );
+    if (blocks) {
+        packBlocks(wordList, input, output, threads, blockSize, optimal,
+                   codeBits, huffman);
+    } else if (pipeline) {
+        packPipelined(wordList, input, output, optimal);
+    } else if (optimal) {
+        packStreamOptimal(wordList, input, output);
+    } else {
+        packStream(wordList, input, output);
     }
     
-    // printf("Break\n");
+    if (syncIndex) {
+        FILE *fp = fopen(syncFile, "wb");
+        if (!fp || !writeSyncIndex(syncIndex, fp) || fclose(fp) != 0) {
+            fprintf(stderr, FILE_ERROR, syncFile);
+            error(USAGE);
+        }
+        freeSyncIndex(syncIndex);
+    }
     
-    // Write out any remaining bits in the last, partial byte.
-    flushBits( &pending, output );
+    if (stats) {
+        reportStats(stats, wordList, json, stderr);
+        freeStats(stats);
+    }
     
     // Free memory
     freeWordList(wordList);
     fclose(input);
-    fclose(output);
-    free(buffer);
+    if (fclose(output) != 0) {
+        error(WRITE_ERROR);
+    }
     
     return EXIT_SUCCESS;
 }
@@ -0,0 +1,295 @@
+/**
+ * @file pipeline.c
+ * @author Sam Whitlock (sjwhitlo)
+ *
+ * A three stage pipeline, used to overlap reading and writing a stream
+ * with encoding or decoding it.
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <sched.h>
+
+#include "pipeline.h"
+
+/** The queues and buffers shared by the three stages. */
+typedef struct {
+  /** The file being read. */
+  FILE *input;
+
+  /** Bytes already read from the start of the file, and how many are left. */
+  const unsigned char *prefix;
+  size_t prefixLen;
+
+  /** Number of bytes read at a time. */
+  size_t inSize;
+
+  /** The middle stage, and its argument. */
+  PipeStage stage;
+  void *arg;
+
+  /** Statistics, or NULL. */
+  Stats *stats;
+
+  /** Buffers read, from the reader to the middle stage. */
+  SpscRing filled;
+
+  /** Input buffers to reuse, from the middle stage to the reader. */
+  SpscRing emptied;
+
+  /** Output ready to write, from the middle stage to the writer. */
+  SpscRing ready;
+
+  /** Output buffers to reuse, from the writer to the middle stage. */
+  SpscRing written;
+} Pipeline;
+
+/**
+ * Gets an empty queue ready to use.
+ *
+ * @param ring The queue
+ */
+static void initRing( SpscRing *ring )
+{
+    ring->head = ring->tail = 0;
+    ring->sleepers = 0;
+    pthread_mutex_init(&ring->lock, NULL);
+    pthread_cond_init(&ring->changed, NULL);
+}
+
+/**
+ * Frees what a queue uses to put threads to sleep.
+ *
+ * @param ring The queue
+ */
+static void freeRing( SpscRing *ring )
+{
+    pthread_mutex_destroy(&ring->lock);
+    pthread_cond_destroy(&ring->changed);
+}
+
+/**
+ * Waits until the other end of a queue moves a counter on from the
+ * given value, first checking a few times, then sleeping.
+ *
+ * @param ring The queue
+ * @param counter The head or tail of the queue, changed by the other end
+ * @param value The value to wait for it to move on from
+ */
+static void ringWait( SpscRing *ring, size_t *counter, size_t value )
+{
+    for (int i = 0; i < RING_SPINS; i++) {
+        if (__atomic_load_n(counter, __ATOMIC_ACQUIRE) != value) {
+            return;
+        }
+        sched_yield();
+    }
+
+    // Say we're asleep before the last check, so the other end either
+    // sees us in ringWake() or has already moved the counter on
+    pthread_mutex_lock(&ring->lock);
+    __atomic_add_fetch(&ring->sleepers, 1, __ATOMIC_SEQ_CST);
+    while (__atomic_load_n(counter, __ATOMIC_SEQ_CST) == value) {
+        pthread_cond_wait(&ring->changed, &ring->lock);
+    }
+    __atomic_sub_fetch(&ring->sleepers, 1, __ATOMIC_SEQ_CST);
+    pthread_mutex_unlock(&ring->lock);
+}
+
+/**
+ * Wakes the other end of a queue if it's asleep, after this end has
+ * moved its counter on.
+ *
+ * @param ring The queue
+ */
+static void ringWake( SpscRing *ring )
+{
+    if (__atomic_load_n(&ring->sleepers, __ATOMIC_SEQ_CST) > 0) {
+        pthread_mutex_lock(&ring->lock);
+        pthread_cond_broadcast(&ring->changed);
+        pthread_mutex_unlock(&ring->lock);
+    }
+}
+
+/**
+ * Adds a buffer to the end of a queue, waiting while it's full.
+ *
+ * @param ring The queue
+ * @param buf The buffer
+ */
+static void ringPush( SpscRing *ring, PipeBuffer *buf )
+{
+    size_t tail = ring->tail;
+    size_t head = __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE);
+    if (tail - head == RING_SLOTS) {
+        ringWait(ring, &ring->head, head);
+    }
+    ring->slots[tail % RING_SLOTS] = buf;
+
+    // Publish the slot only once it's filled in
+    __atomic_store_n(&ring->tail, tail + 1, __ATOMIC_SEQ_CST);
+    ringWake(ring);
+}
+
+/**
+ * Takes the buffer at the front of a queue, waiting while it's empty.
+ *
+ * @param ring The queue
+ * @return The buffer
+ */
+static PipeBuffer *ringPop( SpscRing *ring )
+{
+    size_t head = ring->head;
+    ringWait(ring, &ring->tail, head);
+    PipeBuffer *buf = ring->slots[head % RING_SLOTS];
+
+    // Hand the slot back only once we're done reading it
+    __atomic_store_n(&ring->head, head + 1, __ATOMIC_SEQ_CST);
+    ringWake(ring);
+    return buf;
+}
+
+/**
+ * Reads the input into empty buffers until the end of the file.
+ *
+ * @param arg The pipeline
+ * @return NULL
+ */
+static void *readStage( void *arg )
+{
+    Pipeline *pipe = (Pipeline *)arg;
+
+    bool last = false;
+    while (!last) {
+        PipeBuffer *buf = ringPop(&pipe->emptied);
+        double start = statsClock(pipe->stats);
+        size_t len = pipe->prefixLen < pipe->inSize ? pipe->prefixLen : pipe->inSize;
+        if (len > 0) {
+            memcpy(buf->data, pipe->prefix, len);
+            pipe->prefix += len;
+            pipe->prefixLen -= len;
+        }
+        buf->len = len + fread(buf->data + len, 1, pipe->inSize - len, pipe->input);
+        lapStats(pipe->stats, PHASE_INPUT, start);
+        last = buf->last = buf->len < pipe->inSize;
+        ringPush(&pipe->filled, buf);
+    }
+
+    return NULL;
+}
+
+/**
+ * Runs the middle stage on each buffer read, until the last one.
+ *
+ * @param arg The pipeline
+ * @return NULL
+ */
+static void *workStage( void *arg )
+{
+    Pipeline *pipe = (Pipeline *)arg;
+
+    bool last = false;
+    while (!last) {
+        PipeBuffer *in = ringPop(&pipe->filled);
+        PipeBuffer *out = ringPop(&pipe->written);
+        out->len = pipe->stage(pipe->arg, in->data, in->len, in->last, out->data);
+        last = out->last = in->last;
+        ringPush(&pipe->emptied, in);
+        ringPush(&pipe->ready, out);
+    }
+
+    return NULL;
+}
+
+/**
+ * Allocates count buffers of the given size and queues them.
+ *
+ * @param ring The queue
+ * @param bufs The buffers
+ * @param count The number of buffers
+ * @param size The size of each one
+ */
+static void fillRing( SpscRing *ring, PipeBuffer *bufs, int count, size_t size )
+{
+    initRing(ring);
+    for (int i = 0; i < count; i++) {
+        bufs[i].data = (unsigned char *)malloc(size);
+        ringPush(ring, bufs + i);
+    }
+}
+
+/**
+ * Reads the whole of input on one thread, passes each piece through
+ * stage on another, and writes the results to output on the calling
+ * thread, returning once it's all written.
+ *
+ * @param input The file to read
+ * @param prefix Bytes already read from the start of input, which come
+ * before the rest of it, or NULL
+ * @param prefixLen The number of bytes in prefix
+ * @param output The file to write
+ * @param inSize The number of bytes read at a time
+ * @param outSize The size of each output buffer, big enough for the
+ * most stage can store from one input buffer
+ * @param stage The function run on each input buffer
+ * @param arg The argument passed to stage
+ * @param stats Statistics the time spent reading and writing is added
+ * to, or NULL.  The stage keeps track of everything else.
+ * @return false if the output couldn't be written
+ */
+bool runPipeline( FILE *input, const unsigned char *prefix, size_t prefixLen,
+                  FILE *output, size_t inSize, size_t outSize,
+                  PipeStage stage, void *arg, Stats *stats )
+{
+    Pipeline pipe;
+    pipe.input = input;
+    pipe.prefix = prefix;
+    pipe.prefixLen = prefixLen;
+    pipe.inSize = inSize;
+    pipe.stage = stage;
+    pipe.arg = arg;
+    pipe.stats = stats;
+
+    // Every buffer starts out empty
+    PipeBuffer inBufs[PIPE_BUFFERS];
+    PipeBuffer outBufs[PIPE_BUFFERS];
+    fillRing(&pipe.emptied, inBufs, PIPE_BUFFERS, inSize);
+    fillRing(&pipe.written, outBufs, PIPE_BUFFERS, outSize);
+    initRing(&pipe.filled);
+    initRing(&pipe.ready);
+
+    pthread_t reader, worker;
+    pthread_create(&reader, NULL, readStage, &pipe);
+    pthread_create(&worker, NULL, workStage, &pipe);
+
+    // Write output as it's ready.  After a failed write, keep taking
+    // buffers so the other stages can finish.
+    bool ok = true;
+    bool last = false;
+    while (!last) {
+        PipeBuffer *buf = ringPop(&pipe.ready);
+        double start = statsClock(stats);
+        if (ok && fwrite(buf->data, 1, buf->len, output) != buf->len) {
+            ok = false;
+        }
+        lapStats(stats, PHASE_OUTPUT, start);
+        last = buf->last;
+        ringPush(&pipe.written, buf);
+    }
+
+    pthread_join(reader, NULL);
+    pthread_join(worker, NULL);
+    for (int i = 0; i < PIPE_BUFFERS; i++) {
+        free(inBufs[i].data);
+        free(outBufs[i].data);
+    }
+    freeRing(&pipe.filled);
+    freeRing(&pipe.emptied);
+    freeRing(&pipe.ready);
+    freeRing(&pipe.written);
+
+    return ok;
+}
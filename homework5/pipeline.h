@@ -0,0 +1,119 @@
+/**
+ * @file pipeline.h
+ * @author Sam Whitlock (sjwhitlo)
+ *
+ * Header file for pipeline.c, which runs reading, processing and writing
+ * a file on three threads, so reading and writing overlap with the work
+ * in between.  The threads hand each other buffers through single
+ * producer, single consumer ring queues, and every buffer is allocated
+ * once and passed back to be reused.
+ */
+
+#ifndef _PIPELINE_H_
+#define _PIPELINE_H_
+
+#include <stdio.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <pthread.h>
+
+#include "stats.h"
+
+/** Number of buffers on each side of the middle stage.  Two lets a
+    thread fill one while the next stage empties the other; a couple
+    more smooth out uneven reads and writes. */
+#define PIPE_BUFFERS 4
+
+/** Number of slots in a ring queue.  This is a power of two, and at least
+    PIPE_BUFFERS, so a queue never fills up. */
+#define RING_SLOTS 8
+
+/** Size of a cache line, used to keep the two ends of a queue apart. */
+#define CACHE_LINE 64
+
+/** Number of times a thread checks a full or empty queue again, giving
+    up the processor in between, before it sleeps until the other end
+    changes it. */
+#define RING_SPINS 16
+
+/** A buffer passed between the stages of a pipeline. */
+typedef struct {
+  /** The bytes. */
+  unsigned char *data;
+
+  /** Number of bytes used. */
+  size_t len;
+
+  /** True for the last buffer of the file. */
+  bool last;
+} PipeBuffer;
+
+/** Queue of buffers from one thread to another.  Only the producer
+    changes tail and only the consumer changes head, so no lock is
+    needed to move buffers.  An end that finds the queue full or empty
+    checks it a few more times, then sleeps on changed until the other
+    end wakes it, so a pipeline waiting on a slow input doesn't keep a
+    processor busy.  The lock is only taken while someone is asleep. */
+typedef struct {
+  /** The queued buffers, at positions head through tail - 1, taken
+      modulo RING_SLOTS. */
+  PipeBuffer *slots[ RING_SLOTS ];
+
+  /** Number of buffers ever pushed. */
+  size_t tail;
+
+  /** Keeps head off the cache line the producer writes. */
+  char pad[ CACHE_LINE ];
+
+  /** Number of buffers ever popped. */
+  size_t head;
+
+  /** Number of threads asleep waiting for the queue to change. */
+  int sleepers;
+
+  /** Lock held while going to sleep on the queue or waking a sleeper. */
+  pthread_mutex_t lock;
+
+  /** Signalled when a buffer is pushed or popped while someone sleeps. */
+  pthread_cond_t changed;
+} SpscRing;
+
+/** Function run by the middle stage for each buffer read.  It keeps any
+    state it needs in arg, so it can carry input over from one buffer
+    to the next.
+    @param arg the argument passed to runPipeline().
+    @param in the bytes read.
+    @param len the number of bytes, which is less than the input buffer
+    size only for the last buffer, and may be zero then.
+    @param last true for the last buffer of the file.
+    @param out buffer for the output, the output buffer size given to
+    runPipeline().
+    @return the number of bytes stored in out.
+*/
+typedef size_t (*PipeStage)( void *arg, const unsigned char *in, size_t len,
+                             bool last, unsigned char *out );
+
+/**
+ * Reads the whole of input on one thread, passes each piece through
+ * stage on another, and writes the results to output on the calling
+ * thread, returning once it's all written.
+ *
+ * @param input The file to read
+ * @param prefix Bytes already read from the start of input, which come
+ * before the rest of it, or NULL
+ * @param prefixLen The number of bytes in prefix
+ * @param output The file to write
+ * @param inSize The number of bytes read at a time
+ * @param outSize The size of each output buffer, big enough for the
+ * most stage can store from one input buffer
+ * @param stage The function run on each input buffer
+ * @param arg The argument passed to stage
+ * @param stats Statistics the time spent reading and writing is added
+ * to, or NULL.  The stage keeps track of everything else.
+ * @return false if the output couldn't be written
+ */
+bool runPipeline( FILE *input, const unsigned char *prefix, size_t prefixLen,
+                  FILE *output, size_t inSize, size_t outSize,
+                  PipeStage stage, void *arg, Stats *stats );
+
+#endif
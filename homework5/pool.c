@@ -0,0 +1,138 @@
+/**
+ * @file pool.c
+ * @author Sam Whitlock (sjwhitlo)
+ *
+ * A pool of worker threads, used to encode and decode blocks in parallel.
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdlib.h>
+#include <unistd.h>
+
+#include "pool.h"
+
+/**
+ * Runs jobs from the pool's current batch until the pool is freed.
+ *
+ * @param arg The pool
+ * @return NULL
+ */
+static void *worker( void *arg )
+{
+    ThreadPool *pool = (ThreadPool *)arg;
+    
+    pthread_mutex_lock(&pool->lock);
+    while (true) {
+        // Wait for a job to claim
+        while (!pool->stopping && pool->next >= pool->count) {
+            pthread_cond_wait(&pool->start, &pool->lock);
+        }
+        if (pool->stopping) {
+            break;
+        }
+        int job = pool->next++;
+        
+        // Run it without holding the lock
+        pthread_mutex_unlock(&pool->lock);
+        pool->function(pool->arg, job);
+        pthread_mutex_lock(&pool->lock);
+        
+        if (++pool->finished == pool->count) {
+            pthread_cond_signal(&pool->done);
+        }
+    }
+    pthread_mutex_unlock(&pool->lock);
+    
+    return NULL;
+}
+
+/**
+ * Returns the number of processors available, which is the default
+ * number of worker threads.
+ *
+ * @return The number of processors
+ */
+int processorCount( void )
+{
+    long count = sysconf(_SC_NPROCESSORS_ONLN);
+    return count > 0 ? (int)count : 1;
+}
+
+/**
+ * Makes a pool with the given number of worker threads.
+ *
+ * @param threadCount The number of threads
+ * @return The new pool
+ */
+ThreadPool *makeThreadPool( int threadCount )
+{
+    ThreadPool *pool = (ThreadPool *)malloc(sizeof(ThreadPool));
+    pthread_mutex_init(&pool->lock, NULL);
+    pthread_cond_init(&pool->start, NULL);
+    pthread_cond_init(&pool->done, NULL);
+    pool->next = 0;
+    pool->count = 0;
+    pool->finished = 0;
+    pool->stopping = false;
+    
+    pool->threadCount = threadCount;
+    pool->threads = (pthread_t *)malloc(threadCount * sizeof(pthread_t));
+    for (int i = 0; i < threadCount; i++) {
+        pthread_create(&pool->threads[i], NULL, worker, pool);
+    }
+    
+    return pool;
+}
+
+/**
+ * Runs jobs 0 through count - 1 on the pool's threads, returning
+ * once they have all finished.
+ *
+ * @param pool The pool
+ * @param function The function to run for each job
+ * @param arg The argument passed to function
+ * @param count The number of jobs
+ */
+void runJobs( ThreadPool *pool, JobFunction function, void *arg, int count )
+{
+    if (count == 0) {
+        return;
+    }
+    
+    pthread_mutex_lock(&pool->lock);
+    pool->function = function;
+    pool->arg = arg;
+    pool->finished = 0;
+    pool->next = 0;
+    pool->count = count;
+    pthread_cond_broadcast(&pool->start);
+    
+    while (pool->finished < pool->count) {
+        pthread_cond_wait(&pool->done, &pool->lock);
+    }
+    pthread_mutex_unlock(&pool->lock);
+}
+
+/**
+ * Stops the worker threads and frees the pool.
+ *
+ * @param pool The pool being freed
+ */
+void freeThreadPool( ThreadPool *pool )
+{
+    pthread_mutex_lock(&pool->lock);
+    pool->stopping = true;
+    pthread_cond_broadcast(&pool->start);
+    pthread_mutex_unlock(&pool->lock);
+    
+    for (int i = 0; i < pool->threadCount; i++) {
+        pthread_join(pool->threads[i], NULL);
+    }
+    
+    pthread_mutex_destroy(&pool->lock);
+    pthread_cond_destroy(&pool->start);
+    pthread_cond_destroy(&pool->done);
+    free(pool->threads);
+    free(pool);
+}
@@ -0,0 +1,90 @@
+/**
+ * @file pool.h
+ * @author Sam Whitlock (sjwhitlo)
+ *
+ * Header file for pool.c, a small pool of worker threads that runs
+ * batches of numbered jobs.
+ */
+
+#ifndef _POOL_H_
+#define _POOL_H_
+
+#include <pthread.h>
+#include <stdbool.h>
+
+/** Function run for each job in a batch.  It's given the argument passed
+    to runJobs() and the number of the job, from 0 up to the job count. */
+typedef void (*JobFunction)( void *arg, int job );
+
+/** Representation for a pool of worker threads.  Workers take the
+    next unclaimed job in the current batch until there are none left. */
+typedef struct {
+  /** The worker threads. */
+  pthread_t *threads;
+
+  /** Number of worker threads. */
+  int threadCount;
+
+  /** Lock protecting the rest of the fields. */
+  pthread_mutex_t lock;
+
+  /** Signalled when a new batch of jobs starts, or the pool is freed. */
+  pthread_cond_t start;
+
+  /** Signalled when the last job of a batch finishes. */
+  pthread_cond_t done;
+
+  /** Function to run for each job in the current batch. */
+  JobFunction function;
+
+  /** Argument passed to function. */
+  void *arg;
+
+  /** Number of the next job that hasn't been claimed. */
+  int next;
+
+  /** Number of jobs in the current batch. */
+  int count;
+
+  /** Number of jobs in the current batch that have finished. */
+  int finished;
+
+  /** True when the workers should exit. */
+  bool stopping;
+} ThreadPool;
+
+/**
+ * Returns the number of processors available, which is the default
+ * number of worker threads.
+ *
+ * @return The number of processors
+ */
+int processorCount( void );
+
+/**
+ * Makes a pool with the given number of worker threads.
+ *
+ * @param threadCount The number of threads
+ * @return The new pool
+ */
+ThreadPool *makeThreadPool( int threadCount );
+
+/**
+ * Runs jobs 0 through count - 1 on the pool's threads, returning
+ * once they have all finished.
+ *
+ * @param pool The pool
+ * @param function The function to run for each job
+ * @param arg The argument passed to function
+ * @param count The number of jobs
+ */
+void runJobs( ThreadPool *pool, JobFunction function, void *arg, int count );
+
+/**
+ * Stops the worker threads and frees the pool.
+ *
+ * @param pool The pool being freed
+ */
+void freeThreadPool( ThreadPool *pool );
+
+#endif
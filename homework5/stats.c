@@ -0,0 +1,272 @@
+/**
+ * @file stats.c
+ * @author Sam Whitlock (sjwhitlo)
+ *
+ * Statistics on compressing and uncompressing, for --stats.
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "stats.h"
+#include "bits.h"
+
+/** Number of most used dictionary words listed. */
+#define TOP_WORDS 10
+/** Percent, for reporting shares. */
+#define PERCENT 100.0
+/** Names of the phases, in the order of StatsPhase. */
+#define PHASE_NAMES { "input", "words", "bits", "output" }
+
+/** A code and how often it was used, for sorting by use. */
+typedef struct {
+  /** The code. */
+  int code;
+
+  /** Number of times it was used. */
+  uint64_t uses;
+} CodeUse;
+
+/**
+ * Initializes empty statistics.
+ *
+ * @param stats The statistics
+ */
+void initStats( Stats *stats )
+{
+    stats->bytesIn = 0;
+    stats->bytesOut = 0;
+    stats->uses = (uint64_t *)calloc(1 << MAX_CODE_BITS, sizeof(uint64_t));
+    for (int i = 0; i < PHASE_COUNT; i++) {
+        stats->seconds[i] = 0;
+    }
+}
+
+/**
+ * Returns the time, for starting a stopwatch passed to lapStats().
+ *
+ * @param stats The statistics, or NULL if they aren't being kept, in
+ * which case the clock isn't read
+ * @return Seconds since some fixed point in the past
+ */
+double statsClock( Stats *stats )
+{
+    if (!stats) {
+        return 0;
+    }
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/**
+ * Adds the time since the stopwatch was started to a phase.
+ *
+ * @param stats The statistics, or NULL
+ * @param phase The phase
+ * @param since The stopwatch, from statsClock() or the last lap
+ * @return The time now, for timing the next phase
+ */
+double lapStats( Stats *stats, StatsPhase phase, double since )
+{
+    double now = statsClock(stats);
+    if (stats) {
+        stats->seconds[phase] += now - since;
+    }
+    return now;
+}
+
+/**
+ * Adds to the number of bytes read and written.
+ *
+ * @param stats The statistics, or NULL
+ * @param in Number of bytes read
+ * @param out Number of bytes written
+ */
+void addBytes( Stats *stats, uint64_t in, uint64_t out )
+{
+    if (stats) {
+        stats->bytesIn += in;
+        stats->bytesOut += out;
+    }
+}
+
+/**
+ * Counts a batch of codes.
+ *
+ * @param stats The statistics, or NULL
+ * @param codes The codes
+ * @param n The number of codes
+ */
+void countCodes( Stats *stats, const uint16_t *codes, size_t n )
+{
+    if (stats) {
+        for (size_t i = 0; i < n; i++) {
+            stats->uses[codes[i]]++;
+        }
+    }
+}
+
+/**
+ * Adds counts for each code to the totals, and clears them.
+ *
+ * @param stats The statistics
+ * @param uses The counts
+ * @param n The number of codes counted
+ */
+void mergeUses( Stats *stats, uint64_t *uses, int n )
+{
+    for (int i = 0; i < n; i++) {
+        stats->uses[i] += uses[i];
+        uses[i] = 0;
+    }
+}
+
+/**
+ * Compares two codes by use, most used first, then by code.
+ *
+ * @param a A pointer to the first CodeUse
+ * @param b A pointer to the second CodeUse
+ * @return neg if a comes first, 0 if equal, else pos
+ */
+static int compareUses( const void *a, const void *b )
+{
+    const CodeUse *ua = (const CodeUse *)a;
+    const CodeUse *ub = (const CodeUse *)b;
+    if (ua->uses != ub->uses) {
+        return ua->uses > ub->uses ? -1 : 1;
+    }
+    return ua->code - ub->code;
+}
+
+/**
+ * Prints a word as a JSON string, escaping the chars that need it.
+ *
+ * @param fp The file to print to
+ * @param word The chars of the word
+ * @param len The number of chars
+ */
+static void printJsonWord( FILE *fp, const char *word, int len )
+{
+    fputc('"', fp);
+    for (int i = 0; i < len; i++) {
+        if (word[i] == '"' || word[i] == '\\') {
+            fprintf(fp, "\\%c", word[i]);
+        } else if (word[i] == '\t') {
+            fputs("\\t", fp);
+        } else if (word[i] == '\n') {
+            fputs("\\n", fp);
+        } else if (word[i] == '\r') {
+            fputs("\\r", fp);
+        } else {
+            fputc(word[i], fp);
+        }
+    }
+    fputc('"', fp);
+}
+
+/**
+ * Prints the statistics: the bytes in and out, the number of codes
+ * and how many chars their words have, how often dictionary words
+ * were used, the most used words, and the time in each phase.
+ *
+ * @param stats The statistics
+ * @param wordList The word list the codes are for
+ * @param json True to print them as a JSON object
+ * @param fp The file to print to
+ */
+void reportStats( Stats *stats, WordList *wordList, bool json, FILE *fp )
+{
+    // Codes by the length of their word, and the dictionary words used.
+    // Every word longer than a single char came from the word file.
+    uint64_t lengths[WORD_MAX + 1] = { 0 };
+    uint64_t codes = 0;
+    uint64_t hits = 0;
+    int wordsUsed = 0;
+    int dictWords = 0;
+    CodeUse *top = (CodeUse *)malloc(wordList->len * sizeof(CodeUse));
+    for (int code = 0; code < wordList->len; code++) {
+        int len = wordList->spans[code].length;
+        uint64_t uses = stats->uses[code];
+        codes += uses;
+        lengths[len] += uses;
+        if (len > 1) {
+            hits += uses;
+            wordsUsed += uses > 0;
+            top[dictWords].code = code;
+            top[dictWords].uses = uses;
+            dictWords++;
+        }
+    }
+    qsort(top, dictWords, sizeof(CodeUse), compareUses);
+    int topCount = dictWords < TOP_WORDS ? dictWords : TOP_WORDS;
+    while (topCount > 0 && top[topCount - 1].uses == 0) {
+        topCount--;
+    }
+    double hitRate = codes ? hits * PERCENT / codes : 0;
+    const char *phases[] = PHASE_NAMES;
+
+    if (json) {
+        fprintf(fp, "{\"bytesIn\": %lu, \"bytesOut\": %lu, \"codes\": %lu,\n",
+                (unsigned long)stats->bytesIn, (unsigned long)stats->bytesOut,
+                (unsigned long)codes);
+        fprintf(fp, " \"codeLengths\": [");
+        for (int len = 1; len <= WORD_MAX; len++) {
+            fprintf(fp, "%s%lu", len > 1 ? ", " : "", (unsigned long)lengths[len]);
+        }
+        fprintf(fp, "],\n \"wordHits\": %lu, \"hitRate\": %.2f,"
+                " \"wordsUsed\": %d, \"dictionaryWords\": %d,\n \"topWords\": [",
+                (unsigned long)hits, hitRate, wordsUsed, dictWords);
+        for (int i = 0; i < topCount; i++) {
+            WordSpan span = wordList->spans[top[i].code];
+            fprintf(fp, "%s\n  {\"code\": %d, \"word\": ", i ? "," : "", top[i].code);
+            printJsonWord(fp, wordList->pool + span.offset, span.length);
+            fprintf(fp, ", \"uses\": %lu}", (unsigned long)top[i].uses);
+        }
+        fprintf(fp, "],\n \"seconds\": {");
+        for (int i = 0; i < PHASE_COUNT; i++) {
+            fprintf(fp, "%s\"%s\": %.6f", i ? ", " : "", phases[i], stats->seconds[i]);
+        }
+        fprintf(fp, "}}\n");
+    } else {
+        fprintf(fp, "Bytes in: %lu\nBytes out: %lu\nCodes: %lu\n",
+                (unsigned long)stats->bytesIn, (unsigned long)stats->bytesOut,
+                (unsigned long)codes);
+        fprintf(fp, "Codes by word length:\n");
+        for (int len = 1; len <= WORD_MAX; len++) {
+            if (lengths[len] > 0) {
+                fprintf(fp, "  %2d: %lu\n", len, (unsigned long)lengths[len]);
+            }
+        }
+        fprintf(fp, "Dictionary words: %.2f%% of codes, %d of %d words used\n",
+                hitRate, wordsUsed, dictWords);
+        fprintf(fp, "Most used words:\n");
+        for (int i = 0; i < topCount; i++) {
+            WordSpan span = wordList->spans[top[i].code];
+            fprintf(fp, "  %5d ", top[i].code);
+            printJsonWord(fp, wordList->pool + span.offset, span.length);
+            fprintf(fp, " %lu (%.2f%%)\n", (unsigned long)top[i].uses,
+                    top[i].uses * PERCENT / codes);
+        }
+        fprintf(fp, "Seconds:");
+        for (int i = 0; i < PHASE_COUNT; i++) {
+            fprintf(fp, " %s %.3f", phases[i], stats->seconds[i]);
+        }
+        fprintf(fp, "\n");
+    }
+
+    free(top);
+}
+
+/**
+ * Frees the memory used by statistics.
+ *
+ * @param stats The statistics
+ */
+void freeStats( Stats *stats )
+{
+    free(stats->uses);
+}
@@ -0,0 +1,125 @@
+/**
+ * @file stats.h
+ * @author Sam Whitlock (sjwhitlo)
+ *
+ * Header file for stats.c, which collects the statistics pack and unpack
+ * report with --stats or --stats-json.  Counters are only updated once
+ * for each buffer or batch of codes, so they're cheap enough to leave on.
+ */
+
+#ifndef _STATS_H_
+#define _STATS_H_
+
+#include <stdio.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "wordlist.h"
+
+/** Parts of the work that time is reported for. */
+typedef enum {
+  /** Reading the input. */
+  PHASE_INPUT,
+
+  /** Choosing the words for the input, or expanding codes to words. */
+  PHASE_WORDS,
+
+  /** Packing or unpacking the bits of the codes. */
+  PHASE_BITS,
+
+  /** Writing the output. */
+  PHASE_OUTPUT,
+
+  /** Number of phases. */
+  PHASE_COUNT
+} StatsPhase;
+
+/** Statistics for one run.  Different threads can update different
+    fields at the same time, but not the same one. */
+typedef struct {
+  /** Number of bytes read. */
+  uint64_t bytesIn;
+
+  /** Number of bytes written. */
+  uint64_t bytesOut;
+
+  /** Number of times each code was used, for every possible code. */
+  uint64_t *uses;
+
+  /** Seconds spent in each phase. */
+  double seconds[ PHASE_COUNT ];
+} Stats;
+
+/**
+ * Initializes empty statistics.
+ *
+ * @param stats The statistics
+ */
+void initStats( Stats *stats );
+
+/**
+ * Returns the time, for starting a stopwatch passed to lapStats().
+ *
+ * @param stats The statistics, or NULL if they aren't being kept, in
+ * which case the clock isn't read
+ * @return Seconds since some fixed point in the past
+ */
+double statsClock( Stats *stats );
+
+/**
+ * Adds the time since the stopwatch was started to a phase.
+ *
+ * @param stats The statistics, or NULL
+ * @param phase The phase
+ * @param since The stopwatch, from statsClock() or the last lap
+ * @return The time now, for timing the next phase
+ */
+double lapStats( Stats *stats, StatsPhase phase, double since );
+
+/**
+ * Adds to the number of bytes read and written.
+ *
+ * @param stats The statistics, or NULL
+ * @param in Number of bytes read
+ * @param out Number of bytes written
+ */
+void addBytes( Stats *stats, uint64_t in, uint64_t out );
+
+/**
+ * Counts a batch of codes.
+ *
+ * @param stats The statistics, or NULL
+ * @param codes The codes
+ * @param n The number of codes
+ */
+void countCodes( Stats *stats, const uint16_t *codes, size_t n );
+
+/**
+ * Adds counts for each code to the totals, and clears them.
+ *
+ * @param stats The statistics
+ * @param uses The counts
+ * @param n The number of codes counted
+ */
+void mergeUses( Stats *stats, uint64_t *uses, int n );
+
+/**
+ * Prints the statistics: the bytes in and out, the number of codes
+ * and how many chars their words have, how often dictionary words
+ * were used, the most used words, and the time in each phase.
+ *
+ * @param stats The statistics
+ * @param wordList The word list the codes are for
+ * @param json True to print them as a JSON object
+ * @param fp The file to print to
+ */
+void reportStats( Stats *stats, WordList *wordList, bool json, FILE *fp );
+
+/**
+ * Frees the memory used by statistics.
+ *
+ * @param stats The statistics
+ */
+void freeStats( Stats *stats );
+
+#endif
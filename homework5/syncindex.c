@@ -0,0 +1,248 @@
+/**
+ * @file syncindex.c
+ * @author Sam Whitlock (sjwhitlo)
+ *
+ * Building, saving and using the sync point index of a stream.
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdlib.h>
+#include <string.h>
+#include <sys/types.h>
+
+#include "syncindex.h"
+
+/** Initial capacity of the sync points. */
+#define INIT_SIZE 64
+
+/**
+ * Adds a sync point to the end of an index.
+ *
+ * @param index The index
+ * @param point The sync point
+ */
+static void addSyncPoint( SyncIndex *index, SyncPoint point )
+{
+    // Resize if needed
+    if (index->count == index->capacity) {
+        index->capacity *= 2;
+        index->points = (SyncPoint *)realloc(index->points,
+                                             index->capacity * sizeof(SyncPoint));
+    }
+    index->points[index->count++] = point;
+}
+
+/**
+ * Starts an empty index, for adding codes to as they're written.
+ *
+ * @param index The index
+ * @param wordList The word list the codes are for
+ * @param interval Number of codes between sync points
+ */
+void initSyncIndex( SyncIndex *index, WordList *wordList, uint32_t interval )
+{
+    index->wordList = wordList;
+    index->interval = interval;
+    index->codes = 0;
+    index->rawLen = 0;
+    index->count = 0;
+    index->capacity = INIT_SIZE;
+    index->points = (SyncPoint *)malloc(INIT_SIZE * sizeof(SyncPoint));
+}
+
+/**
+ * Adds the next codes of a stream to its index, recording a sync point
+ * for every interval codes.
+ *
+ * @param index The index, or NULL if none is being built
+ * @param codes The codes, in the order they're written
+ * @param n The number of codes
+ */
+void addSyncCodes( SyncIndex *index, const uint16_t *codes, size_t n )
+{
+    if (!index) {
+        return;
+    }
+    for (size_t i = 0; i < n; i++) {
+        if (index->codes % index->interval == 0) {
+            // Code k starts at bit 9k.  Before reading it, readCode() has
+            // read every byte that holds any of it except the last, and
+            // keeps the low bits of the code that were in the byte it
+            // shares with the code before.
+            uint64_t bit = index->codes * BITS_PER_CODE;
+            SyncPoint point;
+            point.rawOffset = index->rawLen;
+            point.byteOffset = (bit + BITS_PER_BYTE - 1) / BITS_PER_BYTE;
+            point.pending.bitCount = (BITS_PER_BYTE - bit % BITS_PER_BYTE)
+                                     % BITS_PER_BYTE;
+            point.pending.bits = codes[i] & ((1 << point.pending.bitCount) - 1);
+            addSyncPoint(index, point);
+        }
+        index->codes++;
+        index->rawLen += index->wordList->spans[codes[i]].length;
+    }
+}
+
+/**
+ * Writes an index to a sidecar file.
+ *
+ * @param index The index
+ * @param fp The file, opened for writing
+ * @return false if it couldn't be written
+ */
+bool writeSyncIndex( const SyncIndex *index, FILE *fp )
+{
+    unsigned char header[SYNC_HEADER_SIZE] = { 0 };
+    memcpy(header, SYNC_MAGIC, strlen(SYNC_MAGIC));
+    header[strlen(SYNC_MAGIC)] = SYNC_VERSION;
+    putNumber(header + U64_BYTES, index->interval, U32_BYTES);
+    putNumber(header + 2 * U64_BYTES, index->rawLen, U64_BYTES);
+    bool ok = fwrite(header, 1, SYNC_HEADER_SIZE, fp) == SYNC_HEADER_SIZE;
+
+    for (int i = 0; ok && i < index->count; i++) {
+        const SyncPoint *point = index->points + i;
+        unsigned char entry[SYNC_ENTRY_SIZE];
+        putNumber(entry, point->rawOffset, U64_BYTES);
+        putNumber(entry + U64_BYTES, point->byteOffset, SYNC_OFFSET_BYTES);
+        entry[U64_BYTES + SYNC_OFFSET_BYTES] = point->pending.bits;
+        entry[U64_BYTES + SYNC_OFFSET_BYTES + 1] = point->pending.bitCount;
+        ok = fwrite(entry, 1, SYNC_ENTRY_SIZE, fp) == SYNC_ENTRY_SIZE;
+    }
+
+    return ok;
+}
+
+/**
+ * Reads an index from a sidecar file, checking that it's valid.
+ *
+ * @param index The index to fill in
+ * @param fp The file, opened for reading
+ * @return false if the file isn't a valid sync index
+ */
+bool readSyncIndex( SyncIndex *index, FILE *fp )
+{
+    unsigned char header[SYNC_HEADER_SIZE];
+    if (fread(header, 1, SYNC_HEADER_SIZE, fp) != SYNC_HEADER_SIZE
+        || memcmp(header, SYNC_MAGIC, strlen(SYNC_MAGIC)) != 0
+        || header[strlen(SYNC_MAGIC)] != SYNC_VERSION) {
+        return false;
+    }
+    uint32_t interval = getNumber(header + U64_BYTES, U32_BYTES);
+    if (interval == 0) {
+        return false;
+    }
+    initSyncIndex(index, NULL, interval);
+    index->rawLen = getNumber(header + 2 * U64_BYTES, U64_BYTES);
+
+    // Each point has to come after the one before, and the first one is
+    // the start of the stream
+    unsigned char entry[SYNC_ENTRY_SIZE];
+    size_t len;
+    bool ok = true;
+    while (ok && (len = fread(entry, 1, SYNC_ENTRY_SIZE, fp)) > 0) {
+        SyncPoint point;
+        point.rawOffset = getNumber(entry, U64_BYTES);
+        point.byteOffset = getNumber(entry + U64_BYTES, SYNC_OFFSET_BYTES);
+        point.pending.bits = entry[U64_BYTES + SYNC_OFFSET_BYTES];
+        point.pending.bitCount = entry[U64_BYTES + SYNC_OFFSET_BYTES + 1];
+        const SyncPoint *prev = index->count ? index->points + index->count - 1 : NULL;
+        ok = len == SYNC_ENTRY_SIZE && point.pending.bitCount < BITS_PER_BYTE
+             && point.pending.bits < 1 << point.pending.bitCount
+             && point.rawOffset <= index->rawLen
+             && (prev ? point.rawOffset >= prev->rawOffset
+                        && point.byteOffset > prev->byteOffset
+                      : point.rawOffset == 0 && point.byteOffset == 0);
+        addSyncPoint(index, point);
+    }
+
+    if (!ok || index->count == 0) {
+        freeSyncIndex(index);
+        return false;
+    }
+    return true;
+}
+
+/**
+ * Finds the last sync point at or before an uncompressed offset.
+ *
+ * @param index The index, with at least one point
+ * @param start The offset
+ * @return The sync point
+ */
+static const SyncPoint *findSyncPoint( const SyncIndex *index, uint64_t start )
+{
+    int lo = 0;
+    int hi = index->count - 1;
+    while (lo < hi) {
+        int mid = (lo + hi + 1) / 2;
+        if (index->points[mid].rawOffset <= start) {
+            lo = mid;
+        } else {
+            hi = mid - 1;
+        }
+    }
+    return index->points + lo;
+}
+
+/**
+ * Reads part of the uncompressed text of a stream.  Decoding starts at
+ * the last sync point at or before start, so at most interval codes
+ * are decoded before the part that's wanted.
+ *
+ * @param wordList A pointer to the wordlist
+ * @param index The index of the stream
+ * @param fp The stream, opened for reading
+ * @param start Offset of the first uncompressed char to read
+ * @param len Number of chars to read
+ * @param out Buffer for the chars, with room for len chars
+ * @return The number of chars stored, which is less than len only past
+ * the end of the text, or -1 if the stream doesn't match the index
+ */
+long readSyncRange( WordList *wordList, const SyncIndex *index, FILE *fp,
+                    uint64_t start, size_t len, char *out )
+{
+    // Clip the range to the text
+    if (start >= index->rawLen) {
+        return 0;
+    }
+    uint64_t end = len < index->rawLen - start ? start + len : index->rawLen;
+
+    // Pick up reading where the sync point left off
+    const SyncPoint *point = findSyncPoint(index, start);
+    if (fseeko(fp, (off_t)point->byteOffset, SEEK_SET) != 0) {
+        return -1;
+    }
+    PendingBits pending = point->pending;
+    uint64_t pos = point->rawOffset;
+
+    // Skip the words before start, and copy the part of each word after
+    // it until we reach the end
+    size_t stored = 0;
+    while (pos < end) {
+        int code = readCode(&pending, fp);
+        if (code < 0 || code >= wordList->len) {
+            return -1;
+        }
+        WordSpan span = wordList->spans[code];
+        uint64_t from = pos > start ? pos : start;
+        uint64_t to = pos + span.length < end ? pos + span.length : end;
+        if (from < to) {
+            memcpy(out + stored, wordList->pool + span.offset + (from - pos), to - from);
+            stored += to - from;
+        }
+        pos += span.length;
+    }
+
+    return stored;
+}
+
+/**
+ * Frees the sync points of an index.
+ *
+ * @param index The index
+ */
+void freeSyncIndex( SyncIndex *index )
+{
+    free(index->points);
+}
@@ -0,0 +1,143 @@
+/**
+ * @file syncindex.h
+ * @author Sam Whitlock (sjwhitlo)
+ *
+ * Header file for syncindex.c, which supports reading any part of a
+ * compressed stream without decoding everything before it.  While a
+ * stream is packed, a sync point is recorded every so many codes,
+ * giving where that code's chars start in the uncompressed text and
+ * the state readCode() would be in just before reading it.  The points
+ * are saved in a sidecar file next to the stream, so the stream itself
+ * is unchanged and can still be read by anything that reads streams.
+ */
+
+#ifndef _SYNCINDEX_H_
+#define _SYNCINDEX_H_
+
+#include <stdio.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "wordlist.h"
+#include "bits.h"
+
+/** Magic number at the start of a sync index file. */
+#define SYNC_MAGIC "WPSI"
+
+/** Version of the sync index file format. */
+#define SYNC_VERSION 1
+
+/** Size of the header of a sync index file: the magic number, the
+    version, the number of codes between sync points at byte 8, and
+    the size of the uncompressed text at byte 16. */
+#define SYNC_HEADER_SIZE 24
+
+/** Size of each sync point in the file: the uncompressed offset, then
+    the byte offset in 6 bytes, then the pending bits and their count. */
+#define SYNC_ENTRY_SIZE 16
+
+/** Number of bytes holding the byte offset of a sync point. */
+#define SYNC_OFFSET_BYTES 6
+
+/** Default number of codes between sync points. */
+#define SYNC_INTERVAL 1024
+
+/** A place a stream can be read from. */
+typedef struct {
+  /** Offset in the uncompressed text of the first char of the code. */
+  uint64_t rawOffset;
+
+  /** Offset in the stream of the first byte readCode() hasn't read. */
+  uint64_t byteOffset;
+
+  /** Bits of the code readCode() has already read. */
+  PendingBits pending;
+} SyncPoint;
+
+/** The sync points of a stream, in order. */
+typedef struct {
+  /** The word list the codes are for, while the index is being built. */
+  WordList *wordList;
+
+  /** Number of codes between sync points. */
+  uint32_t interval;
+
+  /** Number of codes added so far. */
+  uint64_t codes;
+
+  /** Size of the uncompressed text so far. */
+  uint64_t rawLen;
+
+  /** Number of sync points. */
+  int count;
+
+  /** Capacity of the array, so we can know when we need to resize. */
+  int capacity;
+
+  /** The sync points. */
+  SyncPoint *points;
+} SyncIndex;
+
+/**
+ * Starts an empty index, for adding codes to as they're written.
+ *
+ * @param index The index
+ * @param wordList The word list the codes are for
+ * @param interval Number of codes between sync points
+ */
+void initSyncIndex( SyncIndex *index, WordList *wordList, uint32_t interval );
+
+/**
+ * Adds the next codes of a stream to its index, recording a sync point
+ * for every interval codes.
+ *
+ * @param index The index, or NULL if none is being built
+ * @param codes The codes, in the order they're written
+ * @param n The number of codes
+ */
+void addSyncCodes( SyncIndex *index, const uint16_t *codes, size_t n );
+
+/**
+ * Writes an index to a sidecar file.
+ *
+ * @param index The index
+ * @param fp The file, opened for writing
+ * @return false if it couldn't be written
+ */
+bool writeSyncIndex( const SyncIndex *index, FILE *fp );
+
+/**
+ * Reads an index from a sidecar file, checking that it's valid.
+ *
+ * @param index The index to fill in
+ * @param fp The file, opened for reading
+ * @return false if the file isn't a valid sync index
+ */
+bool readSyncIndex( SyncIndex *index, FILE *fp );
+
+/**
+ * Reads part of the uncompressed text of a stream.  Decoding starts at
+ * the last sync point at or before start, so at most interval codes
+ * are decoded before the part that's wanted.
+ *
+ * @param wordList A pointer to the wordlist
+ * @param index The index of the stream
+ * @param fp The stream, opened for reading
+ * @param start Offset of the first uncompressed char to read
+ * @param len Number of chars to read
+ * @param out Buffer for the chars, with room for len chars
+ * @return The number of chars stored, which is less than len only past
+ * the end of the text, or -1 if the stream doesn't match the index
+ */
+long readSyncRange( WordList *wordList, const SyncIndex *index, FILE *fp,
+                    uint64_t start, size_t len, char *out );
+
+/**
+ * Frees the sync points of an index.
+ *
+ * @param index The index
+ */
+void freeSyncIndex( SyncIndex *index );
+
+#endif
@@ -128,6 +128,82 @@ checkerror() {
   return 0
 }
 
+# Run a file through pack with the given options and then unpack, to make sure
+# we get the original back.  These are for options that don't have a fixed
+# expected output.
+roundtrip() {
+  TEST_NO=$1
+  INPUT=$2
+  ALT_WORDS=$3
+  PACK_OPTS=$4
+  UNPACK_OPTS=$5
+
+  rm -f compressed.raw output.txt stdout.txt stderr.txt
+
+  echo "Test $TEST_NO: ./pack $PACK_OPTS $INPUT compressed.raw $ALT_WORDS && ./unpack $UNPACK_OPTS compressed.raw output.txt $ALT_WORDS"
+  ./pack $PACK_OPTS $INPUT compressed.raw $ALT_WORDS > stdout.txt 2> stderr.txt &&
+  ./unpack $UNPACK_OPTS compressed.raw output.txt $ALT_WORDS >> stdout.txt 2>> stderr.txt
+  STATUS=$?
+
+  if [ $STATUS -ne 0 ]
+  then
+      echo "**** Test $TEST_NO FAILED - incorrect exit status. Expected: 0 Got: $STATUS"
+      FAIL=1
+      return 1
+  fi
+
+  diff -q output.txt $INPUT >/dev/null 2>&1
+  if [ $? -ne 0 ]
+  then
+      echo "**** Test $TEST_NO FAILED - uncompressed output didin't match original input"
+      FAIL=1
+      return 1
+  fi
+
+  if [ -s stderr.txt ] || [ -s stdout.txt ]
+  then
+      echo "**** Test $TEST_NO FAILED - shouldn't print anything to stdout or stderr"
+      FAIL=1
+      return 1
+  fi
+
+  echo "Test $TEST_NO PASS"
+  return 0
+}
+
+# Compress a file into small blocks, then make sure unpack --range gives just
+# the requested part of it.
+rangetest() {
+  TEST_NO=$1
+  INPUT=$2
+  OFFSET=$3
+  LENGTH=$4
+
+  rm -f compressed.raw output.txt stdout.txt stderr.txt
+
+  echo "Test $TEST_NO: ./pack --blocks --block-size 100 $INPUT compressed.raw && ./unpack --range $OFFSET:$LENGTH compressed.raw output.txt"
+  ./pack --blocks --block-size 100 $INPUT compressed.raw > stdout.txt 2> stderr.txt &&
+  ./unpack --range $OFFSET:$LENGTH compressed.raw output.txt >> stdout.txt 2>> stderr.txt
+  STATUS=$?
+
+  if [ $STATUS -ne 0 ]
+  then
+      echo "**** Test $TEST_NO FAILED - incorrect exit status. Expected: 0 Got: $STATUS"
+      FAIL=1
+      return 1
+  fi
+
+  tail -c +$(( OFFSET + 1 )) $INPUT | head -c $LENGTH | cmp -s - output.txt
+  if [ $? -ne 0 ]
+  then
+      echo "**** Test $TEST_NO FAILED - output didin't match that part of the original input"
+      FAIL=1
+      return 1
+  fi
+
+  echo "Test $TEST_NO PASS"
+  return 0
+}
 
 # Run successfule test cases
 runtest 1 ""
@@ -168,6 +244,234 @@ echo "Test 11: ./unpack not-enough-arguments > stdout.txt 2> stderr.txt"
 STATUS=$?
 checkerror 11 $STATUS
 
+# Block-framed files, with small blocks so there are lots of them.
+roundtrip 12 input_5.txt "" "--blocks --block-size 100 --threads 3" ""
+roundtrip 13 input_6.txt "altwords.txt" "--blocks --block-size 1000" ""
+roundtrip 14 input_6.txt "" "--blocks --block-size 100" "--threads 4"
+
+# Codes chosen by optimal parsing, in one stream and in blocks.
+roundtrip 15 input_5.txt "" "--optimal" ""
+roundtrip 16 input_6.txt "altwords.txt" "--optimal --blocks --block-size 500" ""
+
+# Wider codes, for a word list that's too big for 9-bit codes.
+roundtrip 17 input_6.txt "widewords.txt" "--width 10" ""
+roundtrip 18 input_5.txt "" "--width 16 --block-size 100" ""
+
+# Entropy coded blocks.
+roundtrip 19 input_6.txt "" "--huffman --width 12" ""
+roundtrip 20 input_6.txt "altwords.txt" "--huffman --optimal --width 12 --block-size 2000" "--threads 2"
+
+# Codes with Fibonacci frequencies, so the Huffman code would be deeper
+# than HUFF_MAX_BITS and most of it is longer than the decoding table.
+rm -f fibonacci.txt
+awk 'BEGIN { a = 1; b = 1; for (i = 0; i < 26; i++) { for (j = 0; j < a; j++) printf "%c", 65 + i; t = a + b; a = b; b = t } }' > fibonacci.txt
+roundtrip 21 fibonacci.txt "" "--huffman" ""
+
+# Damaged Huffman blocks.  The block starts at byte 16 with its type, then
+# the number of codes; Test 22 makes that too big for the bits there are.
+# The lengths follow, for codes A to Z, and Test 23 lengthens the 1-bit
+# code for Z so some bits aren't a Huffman code any more.
+./pack --huffman fibonacci.txt fibonacci.raw
+rm -f compressed.raw output.txt stdout.txt stderr.txt
+cp fibonacci.raw compressed.raw
+printf '\001' | dd of=compressed.raw bs=1 seek=20 conv=notrunc 2> /dev/null
+echo "Test 22: ./unpack compressed.raw output.txt > stdout.txt 2> stderr.txt"
+./unpack compressed.raw output.txt > stdout.txt 2> stderr.txt
+STATUS=$?
+checkerror 22 $STATUS
+
+rm -f compressed.raw output.txt stdout.txt stderr.txt
+cp fibonacci.raw compressed.raw
+printf '\002' | dd of=compressed.raw bs=1 seek=102 conv=notrunc 2> /dev/null
+echo "Test 23: ./unpack compressed.raw output.txt > stdout.txt 2> stderr.txt"
+./unpack compressed.raw output.txt > stdout.txt 2> stderr.txt
+STATUS=$?
+checkerror 23 $STATUS
+rm -f fibonacci.txt fibonacci.raw
+
+rm -f compressed.raw output.txt stdout.txt stderr.txt
+echo "Test 24: ./pack input_6.txt compressed.raw widewords.txt > stdout.txt 2> stderr.txt"
+./pack input_6.txt compressed.raw widewords.txt > stdout.txt 2> stderr.txt
+STATUS=$?
+checkerror 24 $STATUS
+
+# A compiled word list should work just like the text file it came from.
+rm -f words.bin
+echo "Test 25: ./wordlist compile altwords.txt words.bin"
+./wordlist compile altwords.txt words.bin > stdout.txt 2> stderr.txt
+roundtrip 25 input_6.txt "words.bin" "" ""
+if [ $? -eq 0 ] && ! cmp -s compressed.raw expected_6.raw
+then
+    echo "**** Test 25 FAILED - compressed output didn't match expected_6.raw"
+    FAIL=1
+fi
+rm -f words.bin
+
+# A trained word file should be one pack and unpack accept.
+rm -f trained.txt
+echo "Test 26: ./wordtrain input_6.txt trained.txt"
+./wordtrain input_6.txt trained.txt > stdout.txt 2> stderr.txt
+roundtrip 26 input_6.txt "trained.txt" "" ""
+rm -f trained.txt
+
+# The library should give the same bytes as pack, a small piece at a time.
+echo "Test 27: ./wpstream c words.txt 37 < input_5.txt > compressed.raw"
+./wpstream c words.txt 37 < input_5.txt > compressed.raw 2> stderr.txt
+if [ $? -ne 0 ] || ! cmp -s compressed.raw expected_5.raw
+then
+    echo "**** Test 27 FAILED - compressed output didn't match expected_5.raw"
+    FAIL=1
+else
+    echo "Test 27: ./wpstream d words.txt 37 < compressed.raw > output.txt"
+    ./wpstream d words.txt 37 < compressed.raw > output.txt 2> stderr.txt
+    if [ $? -ne 0 ] || ! cmp -s output.txt input_5.txt
+    then
+        echo "**** Test 27 FAILED - uncompressed output didn't match input_5.txt"
+        FAIL=1
+    else
+        echo "Test 27 PASS"
+    fi
+fi
+
+# Pipelining shouldn't change the output.
+rm -f compressed.raw output.txt
+echo "Test 28: ./pack --pipeline input_4.txt compressed.raw"
+./pack --pipeline input_4.txt compressed.raw > stdout.txt 2> stderr.txt
+if [ $? -ne 0 ] || ! cmp -s compressed.raw expected_4.raw
+then
+    echo "**** Test 28 FAILED - compressed output didn't match expected_4.raw"
+    FAIL=1
+else
+    echo "Test 28: ./unpack --pipeline compressed.raw output.txt"
+    ./unpack --pipeline compressed.raw output.txt > stdout.txt 2> stderr.txt
+    if [ $? -ne 0 ] || ! cmp -s output.txt input_4.txt
+    then
+        echo "**** Test 28 FAILED - uncompressed output didn't match input_4.txt"
+        FAIL=1
+    else
+        echo "Test 28 PASS"
+    fi
+fi
+
+# A batch keeps going past a bad file, and reports it.
+rm -f batch.txt batch_1.raw batch_7.raw batch_1.txt
+printf 'input_1.txt batch_1.raw\ninput_7.txt batch_7.raw\n' > batch.txt
+echo "Test 29: ./pack --batch batch.txt > stdout.txt"
+./pack --batch batch.txt > stdout.txt 2> stderr.txt
+STATUS=$?
+if [ $STATUS -ne 1 ] || ! cmp -s batch_1.raw expected_1.raw \
+   || ! grep -q "input_7.txt: Invalid character code: 96" stdout.txt
+then
+    echo "**** Test 29 FAILED - batch didn't compress input_1.txt and report input_7.txt"
+    FAIL=1
+else
+    printf 'batch_1.raw batch_1.txt\n' > batch.txt
+    echo "Test 29: ./unpack --batch batch.txt > stdout.txt"
+    ./unpack --batch batch.txt > stdout.txt 2> stderr.txt
+    if [ $? -ne 0 ] || ! cmp -s batch_1.txt input_1.txt
+    then
+        echo "**** Test 29 FAILED - uncompressed output didn't match input_1.txt"
+        FAIL=1
+    else
+        echo "Test 29 PASS"
+    fi
+fi
+rm -f batch.txt batch_1.raw batch_7.raw batch_1.txt
+
+# Statistics go to standard error, and don't change the output.
+rm -f compressed.raw
+echo "Test 30: ./pack --stats-json input_5.txt compressed.raw 2> stderr.txt"
+./pack --stats-json input_5.txt compressed.raw > stdout.txt 2> stderr.txt
+if [ $? -ne 0 ] || ! cmp -s compressed.raw expected_5.raw \
+   || ! grep -q '"codes": 1024' stderr.txt
+then
+    echo "**** Test 30 FAILED - output or statistics weren't right"
+    FAIL=1
+else
+    echo "Test 30 PASS"
+fi
+
+# Parts of a stream, found with a sync index.  The stream itself is
+# the same as without one.
+rm -f compressed.raw
+echo "Test 31: ./pack --sync-index sync.idx --sync-every 16 input_6.txt compressed.raw altwords.txt && ./unpack --sync-index sync.idx --range 5003:700 compressed.raw output.txt altwords.txt"
+./pack --sync-index sync.idx --sync-every 16 input_6.txt compressed.raw altwords.txt > stdout.txt 2> stderr.txt &&
+./unpack --sync-index sync.idx --range 5003:700 compressed.raw output.txt altwords.txt >> stdout.txt 2>> stderr.txt
+if [ $? -ne 0 ] || ! cmp -s compressed.raw expected_6.raw \
+   || ! tail -c +5004 input_6.txt | head -c 700 | cmp -s - output.txt
+then
+    echo "**** Test 31 FAILED - stream or range didn't match"
+    FAIL=1
+else
+    echo "Test 31 PASS"
+fi
+rm -f sync.idx
+
+# Parts of block-framed files.
+rangetest 32 input_5.txt 250 1000
+rangetest 33 input_6.txt 7990 500
+
+# A block-framed file whose trailer gives an index offset and block count
+# that only add up to the size of the file if the sum wraps around.
+rm -f compressed.raw output.txt stdout.txt stderr.txt
+printf 'WPAK\001\011\000\000\144\000\000\000\000\000\000\000' > compressed.raw
+head -c 32 /dev/zero >> compressed.raw
+printf '\070\000\000\000\370\377\377\377\377\377\377\377WPIX' >> compressed.raw
+echo "Test 34: ./unpack compressed.raw output.txt > stdout.txt 2> stderr.txt"
+./unpack compressed.raw output.txt > stdout.txt 2> stderr.txt
+STATUS=$?
+checkerror 34 $STATUS
+
+# A block-framed file whose header claims blocks far bigger than the
+# ones in its index.
+rm -f compressed.raw output.txt stdout.txt stderr.txt
+./pack --blocks --block-size 100 input_5.txt compressed.raw
+printf '\377\377\377\377' | dd of=compressed.raw bs=1 seek=8 conv=notrunc 2> /dev/null
+echo "Test 35: ./unpack compressed.raw output.txt > stdout.txt 2> stderr.txt"
+./unpack compressed.raw output.txt > stdout.txt 2> stderr.txt
+STATUS=$?
+checkerror 35 $STATUS
+
+# A compiled word list whose arrays are all in the file, but whose root
+# entry for 'a', at byte 420, points far past the last trie node.
+rm -f compressed.raw output.txt stdout.txt stderr.txt words.bin
+./wordlist compile words.txt words.bin
+printf '\377\377\377\177' | dd of=words.bin bs=1 seek=420 conv=notrunc 2> /dev/null
+echo "Test 36: ./pack input_1.txt compressed.raw words.bin > stdout.txt 2> stderr.txt"
+./pack input_1.txt compressed.raw words.bin > stdout.txt 2> stderr.txt
+STATUS=$?
+checkerror 36 $STATUS
+rm -f words.bin
+
+# Files piped to unpack can't be mapped.  A block-framed one still has to
+# be found by its header, and a stream still has to start with the bytes
+# looked at to tell.
+rm -f compressed.raw output.txt stdout.txt stderr.txt
+echo "Test 37: ./pack --blocks --block-size 100 input_5.txt - | ./unpack - output.txt"
+./pack --blocks --block-size 100 input_5.txt - 2> stderr.txt | ./unpack - output.txt > stdout.txt 2>> stderr.txt
+if [ $? -ne 0 ] || ! cmp -s output.txt input_5.txt || [ -s stderr.txt ] || [ -s stdout.txt ]
+then
+    echo "**** Test 37 FAILED - uncompressed output didn't match input_5.txt"
+    FAIL=1
+else
+    echo "Test 37: cat expected_6.raw | ./unpack --pipeline - output.txt altwords.txt"
+    cat expected_6.raw | ./unpack --pipeline - output.txt altwords.txt > stdout.txt 2> stderr.txt
+    if [ $? -ne 0 ] || ! cmp -s output.txt input_6.txt || [ -s stderr.txt ] || [ -s stdout.txt ]
+    then
+        echo "**** Test 37 FAILED - uncompressed output didn't match input_6.txt"
+        FAIL=1
+    else
+        echo "Test 37 PASS"
+    fi
+fi
+
+# A block size too big to keep a batch of blocks in memory.
+rm -f compressed.raw output.txt stdout.txt stderr.txt
+echo "Test 38: ./pack --blocks --block-size 2000000000 input_5.txt compressed.raw > stdout.txt 2> stderr.txt"
+./pack --blocks --block-size 2000000000 input_5.txt compressed.raw > stdout.txt 2> stderr.txt
+STATUS=$?
+checkerror 38 $STATUS
+
 if [ $FAIL -ne 0 ]; then
   echo "FAILING TESTS!"
   exit 13
@@ -4,22 +4,109 @@
  *
  * Takes two (or 3) command line arguments. Reads a compressed file,
  * and converts it to an uncompressed version based on the wordlist.
+ * Either file name can be given as "-" to use standard input or
+ * standard output.  With the --throughput option, it reports how fast
+ * the codes were decoded.
+ *
+ * When it can, the compressed file is memory mapped instead of being
+ * read, and words are assembled in a large buffer that's written out
+ * with one system call.  Block-framed files written by pack --blocks
+ * are recognized by their header, and one that can't be mapped, like
+ * one piped to standard input, is read into memory first.  Their blocks
+ * are decoded in parallel on --threads threads, and with --range
+ * offset:length only the blocks holding that part of the uncompressed
+ * file are decoded.  A
+ * --range can be read from a file without blocks too, if pack wrote a
+ * sync index for it; it's given with --sync-index, and decoding starts
+ * at the last sync point before the range.
+ *
+ * With the --pipeline option, a file without blocks is read, decoded
+ * and written on three separate threads instead.
+ *
+ * With --stats, or --stats-json for the same thing as JSON, statistics
+ * on the codes read and the time taken are printed to standard error.
+ *
+ * With the --batch option, the file names come from a batch list
+ * instead, one pair to a line, and the word list is loaded only once.
+ * Files are uncompressed in parallel on --threads threads, and a
+ * failure is reported for just the file it happened in.
  */
 
+#define _POSIX_C_SOURCE 200809L
+
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <stdbool.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 
 #include "wordlist.h"
 #include "bits.h"
+#include "codec.h"
+#include "pool.h"
+#include "pipeline.h"
+#include "batch.h"
+#include "stats.h"
+#include "syncindex.h"
 
 /** Usage message. */
 #define USAGE "usage: unpack <compressed.raw> <output.txt> [word_file.txt]"
+/** Usage message for a batch. */
+#define BATCH_USAGE "usage: unpack --batch <list.txt> [word_file.txt]"
 /** Can't open file. */
 #define FILE_ERROR "Can't open file: %s\n"
 /** Expected number of command line arguments. */
 #define CMD_ARGS 3
+/** Option for reporting decode throughput. */
+#define THROUGHPUT_OPT "--throughput"
+/** Throughput report. */
+#define THROUGHPUT "Decoded %lu bytes in %.3f s (%.1f MB/s)\n"
+/** Bytes in a megabyte, for reporting throughput. */
+#define MEGABYTE 1e6
+/** Number of bytes read and decoded at a time.  This is a whole number
+    of groups, so every read starts at the start of a group. */
+#define READ_SIZE ( GROUP_BYTES * 8192 )
+/** Error writing the output. */
+#define WRITE_ERROR "Can't write output"
+/** Error for a word list with more words than there are codes. */
+#define INVAL_WORD_FILE "Invalid word file"
+/** Error for a damaged block-framed file. */
+#define INVAL_BLOCKS "Invalid compressed file"
+/** Error for running out of memory. */
+#define MEMORY_ERROR "Out of memory"
+/** Option for decoding a stream on its own thread. */
+#define PIPELINE_OPT "--pipeline"
+/** Option for uncompressing the files in a batch list, followed by its name. */
+#define BATCH_OPT "--batch"
+/** Can't open file, for a file in a batch. */
+#define BATCH_FILE_ERROR "Can't open file: %s"
+/** Can't write file, for a file in a batch. */
+#define BATCH_WRITE_ERROR "Can't write file: %s"
+/** Invalid batch list. */
+#define INVAL_BATCH "Invalid batch list"
+/** Option for printing statistics. */
+#define STATS_OPT "--stats"
+/** Option for printing statistics as JSON. */
+#define STATS_JSON_OPT "--stats-json"
+/** Option for the number of threads, followed by the number. */
+#define THREADS_OPT "--threads"
+/** Option for decoding part of the file, followed by offset:length. */
+#define RANGE_OPT "--range"
+/** Format of the range given with RANGE_OPT. */
+#define RANGE_FORMAT "%lu:%lu%c"
+/** Error for a range on a file without blocks. */
+#define RANGE_ERROR "Ranges need a block-framed file"
+/** Option for reading a range with a sync index, followed by its name. */
+#define SYNC_INDEX_OPT "--sync-index"
+/** Error for a sync index that's not valid, or not for the file. */
+#define INVAL_SYNC "Invalid sync index"
+/** Number of chars read with the sync index at a time. */
+#define SYNC_CHUNK ( 1 << 20 )
+/** File name standing for standard input or standard output. */
+#define STD_STREAM "-"
 
 /**
  * Prints an error message passed in as a paramater.
@@ -32,6 +119,592 @@ void error(char *message)
     exit(EXIT_FAILURE);
 }
 
+/**
+ * Opens the named file, or returns stdin or stdout for "-".  Prints
+ * an error and exits if the file can't be opened.
+ *
+ * @param fname The name of the file
+ * @param mode The mode to open it with
+ * @param std The stream to use for "-"
+ * @return The opened file
+ */
+FILE *openFile(char *fname, char *mode, FILE *std)
+{
+    if (strcmp(fname, STD_STREAM) == 0) {
+        return std;
+    }
+    FILE *fp = fopen(fname, mode);
+    if (!fp) {
+        fprintf(stderr, FILE_ERROR, fname);
+        error(USAGE);
+    }
+    return fp;
+}
+
+/**
+ * Writes all of the given buffer to a file descriptor, exiting if it
+ * can't be written.
+ *
+ * @param fd The file descriptor
+ * @param buf The chars to write
+ * @param len The number of chars
+ */
+void writeAll(int fd, const char *buf, size_t len)
+{
+    while (len > 0) {
+        ssize_t written = write(fd, buf, len);
+        if (written < 0) {
+            error(WRITE_ERROR);
+        }
+        buf += written;
+        len -= written;
+    }
+}
+
+/**
+ * Maps the whole of the given file into memory, if it's a regular file.
+ *
+ * @param fp The file, opened for reading
+ * @param len Pointer to the size of the mapped file
+ * @return The mapped contents, or NULL if the file can't be mapped
+ */
+const unsigned char *mapFile(FILE *fp, size_t *len)
+{
+    struct stat st;
+    if (fstat(fileno(fp), &st) != 0 || !S_ISREG(st.st_mode) || st.st_size == 0) {
+        return NULL;
+    }
+    void *data = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fileno(fp), 0);
+    if (data == MAP_FAILED) {
+        return NULL;
+    }
+    posix_madvise(data, st.st_size, POSIX_MADV_SEQUENTIAL);
+    *len = st.st_size;
+    return data;
+}
+
+/**
+ * Reads the whole of a file that can't be mapped into memory, after the
+ * bytes already read from the start of it.
+ *
+ * @param fp The file, opened for reading
+ * @param prefix The bytes already read
+ * @param prefixLen The number of bytes in prefix
+ * @param len Pointer to the size of the whole file
+ * @return The contents of the file, which the caller frees
+ */
+unsigned char *readFile(FILE *fp, const unsigned char *prefix, size_t prefixLen,
+                        size_t *len)
+{
+    size_t capacity = READ_SIZE;
+    unsigned char *data = (unsigned char *)malloc(capacity);
+    if (!data) {
+        error(MEMORY_ERROR);
+    }
+    memcpy(data, prefix, prefixLen);
+    size_t total = prefixLen;
+    size_t got;
+    while ((got = fread(data + total, 1, capacity - total, fp)) > 0) {
+        total += got;
+        if (total == capacity) {
+            capacity *= 2;
+            unsigned char *grown = (unsigned char *)realloc(data, capacity);
+            if (!grown) {
+                error(MEMORY_ERROR);
+            }
+            data = grown;
+        }
+    }
+    *len = total;
+    return data;
+}
+
+/** Number of compressed bytes decoded so far. */
+static unsigned long decodedBytes = 0;
+
+/** Seconds spent decoding so far. */
+static double decodeTime = 0;
+
+/** Statistics being kept, or NULL if they weren't asked for. */
+static Stats *stats = NULL;
+
+/**
+ * Returns the current time, for timing how long decoding takes.
+ *
+ * @return Seconds since some fixed point in the past
+ */
+double now(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/**
+ * Uncompresses a continuous stream of codes, one piece at a time.
+ *
+ * @param wordList A pointer to the wordlist
+ * @param input The compressed file
+ * @param output The file to write to
+ * @param mapped The contents of the compressed file if it's been mapped,
+ * or NULL to read it from input
+ * @param mappedLen The size of the mapped file
+ * @param prefix Bytes already read from the start of input, fewer than
+ * READ_SIZE, or NULL
+ * @param prefixLen The number of bytes in prefix
+ */
+void unpackStream(WordList *wordList, FILE *input, FILE *output,
+                  const unsigned char *mapped, size_t mappedLen,
+                  const unsigned char *prefix, size_t prefixLen)
+{
+    size_t mappedPos = 0;
+    
+    // Buffers for a piece of the file, the codes in it and their words
+    unsigned char *packed = (unsigned char *)malloc(READ_SIZE);
+    size_t maxCodes = READ_SIZE / GROUP_BYTES * GROUP_CODES;
+    uint16_t *codes = (uint16_t *)malloc(maxCodes * sizeof(uint16_t));
+    char *text = (char *)malloc(maxCodes * WORD_MAX + WORD_COPY);
+    
+    // Decode a piece at a time
+    double clock = statsClock(stats);
+    while (true) {
+        const unsigned char *block = packed;
+        size_t len;
+        if (mapped) {
+            block = mapped + mappedPos;
+            len = mappedLen - mappedPos < READ_SIZE ? mappedLen - mappedPos : READ_SIZE;
+            mappedPos += len;
+        } else {
+            if (prefixLen > 0) {
+                memcpy(packed, prefix, prefixLen);
+            }
+            len = prefixLen + fread(packed + prefixLen, 1, READ_SIZE - prefixLen, input);
+            prefixLen = 0;
+        }
+        if (len == 0) {
+            break;
+        }
+        addBytes(stats, len, 0);
+        clock = lapStats(stats, PHASE_INPUT, clock);
+        
+        double start = now();
+        size_t n = readCodes(block, len, BITS_PER_CODE, codes);
+        decodeTime += now() - start;
+        decodedBytes += len;
+        clock = lapStats(stats, PHASE_BITS, clock);
+        
+        countCodes(stats, codes, n);
+        size_t textLen = expandCodes(wordList, codes, n, text);
+        clock = lapStats(stats, PHASE_WORDS, clock);
+        
+        // Output
+        writeAll(fileno(output), text, textLen);
+        addBytes(stats, 0, textLen);
+        clock = lapStats(stats, PHASE_OUTPUT, clock);
+    }
+    
+    free(packed);
+    free(codes);
+    free(text);
+}
+
+/** State of the decoding stage of a pipeline. */
+typedef struct {
+  /** The wordlist used for decoding. */
+  WordList *wordList;
+
+  /** Codes for one piece of the file. */
+  uint16_t *codes;
+} StreamDecoder;
+
+/**
+ * Decodes a piece of the file.  Pieces are READ_SIZE bytes, so each
+ * one starts at the start of a group.
+ *
+ * @param arg The StreamDecoder
+ * @param in The bytes read
+ * @param len The number of bytes
+ * @param last True for the end of the file
+ * @param out Buffer for the words
+ * @return The number of chars stored in out
+ */
+size_t decodeStage(void *arg, const unsigned char *in, size_t len, bool last,
+                   unsigned char *out)
+{
+    StreamDecoder *dec = (StreamDecoder *)arg;
+    
+    double clock = statsClock(stats);
+    double start = now();
+    size_t n = readCodes(in, len, BITS_PER_CODE, dec->codes);
+    decodeTime += now() - start;
+    decodedBytes += len;
+    clock = lapStats(stats, PHASE_BITS, clock);
+    
+    countCodes(stats, dec->codes, n);
+    size_t textLen = expandCodes(dec->wordList, dec->codes, n, (char *)out);
+    lapStats(stats, PHASE_WORDS, clock);
+    addBytes(stats, len, textLen);
+    return textLen;
+}
+
+/**
+ * Uncompresses a continuous stream of codes, reading, decoding and
+ * writing on separate threads.
+ *
+ * @param wordList A pointer to the wordlist
+ * @param input The compressed file
+ * @param prefix Bytes already read from the start of input, or NULL
+ * @param prefixLen The number of bytes in prefix
+ * @param output The file to write to
+ */
+void unpackPipelined(WordList *wordList, FILE *input,
+                     const unsigned char *prefix, size_t prefixLen, FILE *output)
+{
+    size_t maxCodes = READ_SIZE / GROUP_BYTES * GROUP_CODES;
+    StreamDecoder dec;
+    dec.wordList = wordList;
+    dec.codes = (uint16_t *)malloc(maxCodes * sizeof(uint16_t));
+    
+    if (!runPipeline(input, prefix, prefixLen, output, READ_SIZE, maxCodes * WORD_MAX + WORD_COPY,
+                     decodeStage, &dec, stats)) {
+        error(WRITE_ERROR);
+    }
+    
+    free(dec.codes);
+}
+
+/** A batch of blocks being decoded in parallel into one buffer. */
+typedef struct {
+  /** The wordlist used for decoding. */
+  WordList *wordList;
+
+  /** The contents of the compressed file. */
+  const unsigned char *mapped;
+
+  /** The index of its blocks. */
+  BlockIndex *index;
+
+  /** The first block in the batch. */
+  int first;
+
+  /** Buffer for the output of the whole batch.  Each block is decoded
+      right where it goes in the output. */
+  char *text;
+
+  /** Number of chars each block decoded to. */
+  size_t *lens;
+
+  /** Number of times each code was used in each block, or NULL if
+      statistics aren't being kept. */
+  uint64_t **uses;
+} DecodeBatch;
+
+/**
+ * Decodes one block of a batch.
+ *
+ * @param arg The batch
+ * @param job The position of the block in the batch
+ */
+void decodeJob(void *arg, int job)
+{
+    DecodeBatch *batch = (DecodeBatch *)arg;
+    BlockIndex *index = batch->index;
+    int b = batch->first + job;
+    
+    batch->lens[job] = decodeBlock(batch->wordList,
+                                   batch->mapped + index->packedOffsets[b],
+                                   index->packedOffsets[b + 1] - index->packedOffsets[b],
+                                   index->codeBits, index->huffman,
+                                   batch->text + (index->rawOffsets[b]
+                                                  - index->rawOffsets[batch->first]),
+                                   index->rawOffsets[b + 1] - index->rawOffsets[b],
+                                   batch->uses ? batch->uses[job] : NULL);
+}
+
+/**
+ * Uncompresses part of a block-framed file.  Only the blocks holding
+ * the chars from start up to end are decoded, in parallel batches
+ * with a few blocks for each thread.
+ *
+ * @param wordList A pointer to the wordlist
+ * @param output The file to write to
+ * @param mapped The contents of the compressed file
+ * @param index The index of its blocks
+ * @param start Offset of the first uncompressed char to write
+ * @param end Offset past the last uncompressed char to write
+ * @param threads The number of threads to decode with
+ */
+void unpackBlocks(WordList *wordList, FILE *output,
+                  const unsigned char *mapped, BlockIndex *index,
+                  uint64_t start, uint64_t end, int threads)
+{
+    // Clip the range to the file
+    uint64_t total = index->rawOffsets[index->count];
+    end = end < total ? end : total;
+    if (start >= end) {
+        return;
+    }
+    
+    // Find the first block holding part of the range.  Block i holds
+    // the chars from rawOffsets[i] up to rawOffsets[i + 1].
+    int lo = 0;
+    int hi = index->count - 1;
+    while (lo < hi) {
+        int mid = (lo + hi + 1) / 2;
+        if (index->rawOffsets[mid] <= start) {
+            lo = mid;
+        } else {
+            hi = mid - 1;
+        }
+    }
+    
+    ThreadPool *pool = makeThreadPool(threads);
+    int batchSize = threads * BLOCKS_PER_THREAD;
+    DecodeBatch batch;
+    batch.wordList = wordList;
+    batch.mapped = mapped;
+    batch.index = index;
+    batch.text = (char *)malloc((size_t)batchSize * index->blockSize);
+    if (!batch.text) {
+        error(MEMORY_ERROR);
+    }
+    batch.lens = (size_t *)malloc(batchSize * sizeof(size_t));
+    batch.uses = NULL;
+    int codeCount = 1 << index->codeBits;
+    if (stats) {
+        batch.uses = (uint64_t **)malloc(batchSize * sizeof(uint64_t *));
+        for (int i = 0; i < batchSize; i++) {
+            batch.uses[i] = (uint64_t *)calloc(codeCount, sizeof(uint64_t));
+        }
+    }
+    double clock = statsClock(stats);
+    
+    // Decode batches until we're past the end of the range
+    for (int b = lo; b < index->count && index->rawOffsets[b] < end; b += batchSize) {
+        int count = 0;
+        while (count < batchSize && b + count < index->count
+               && index->rawOffsets[b + count] < end) {
+            decodedBytes += index->packedOffsets[b + count + 1]
+                            - index->packedOffsets[b + count];
+            addBytes(stats, index->packedOffsets[b + count + 1]
+                     - index->packedOffsets[b + count], 0);
+            count++;
+        }
+        
+        batch.first = b;
+        double started = now();
+        runJobs(pool, decodeJob, &batch, count);
+        decodeTime += now() - started;
+        
+        // Unpacking the bits and expanding the words happen together in
+        // the workers, so it's all counted as expanding words
+        clock = lapStats(stats, PHASE_WORDS, clock);
+        
+        // Every block has to decode to exactly the size in the index
+        for (int i = 0; i < count; i++) {
+            if (batch.lens[i] != index->rawOffsets[b + i + 1] - index->rawOffsets[b + i]) {
+                error(INVAL_BLOCKS);
+            }
+            if (stats) {
+                mergeUses(stats, batch.uses[i], codeCount);
+            }
+        }
+        
+        // Write out the part of the batch in the range
+        uint64_t from = index->rawOffsets[b] > start ? index->rawOffsets[b] : start;
+        uint64_t to = index->rawOffsets[b + count] < end ? index->rawOffsets[b + count] : end;
+        writeAll(fileno(output), batch.text + (from - index->rawOffsets[b]), to - from);
+        addBytes(stats, 0, to - from);
+        clock = lapStats(stats, PHASE_OUTPUT, clock);
+    }
+    
+    freeThreadPool(pool);
+    free(batch.text);
+    free(batch.lens);
+    if (stats) {
+        for (int i = 0; i < batchSize; i++) {
+            free(batch.uses[i]);
+        }
+    }
+    free(batch.uses);
+}
+
+/**
+ * Writes part of the uncompressed contents of a stream, using its sync
+ * index to start decoding just before it.
+ *
+ * @param wordList A pointer to the wordlist
+ * @param input The compressed file, which has to be seekable
+ * @param output The file to write to
+ * @param syncFile The name of the sync index
+ * @param start Offset of the first uncompressed char to write
+ * @param length Number of chars to write
+ */
+void unpackSyncRange(WordList *wordList, FILE *input, FILE *output,
+                     char *syncFile, uint64_t start, uint64_t length)
+{
+    FILE *fp = fopen(syncFile, "rb");
+    if (!fp) {
+        fprintf(stderr, FILE_ERROR, syncFile);
+        error(USAGE);
+    }
+    SyncIndex index;
+    bool ok = readSyncIndex(&index, fp);
+    fclose(fp);
+    if (!ok) {
+        error(INVAL_SYNC);
+    }
+    
+    // Read the range a chunk at a time, so a long one doesn't need a
+    // buffer as big as itself
+    char *text = (char *)malloc(SYNC_CHUNK);
+    double clock = statsClock(stats);
+    while (length > 0) {
+        size_t want = length < SYNC_CHUNK ? length : SYNC_CHUNK;
+        long got = readSyncRange(wordList, &index, input, start, want, text);
+        if (got < 0) {
+            error(INVAL_SYNC);
+        }
+        clock = lapStats(stats, PHASE_WORDS, clock);
+        writeAll(fileno(output), text, got);
+        addBytes(stats, 0, got);
+        clock = lapStats(stats, PHASE_OUTPUT, clock);
+        if (got < want) {
+            break;
+        }
+        start += got;
+        length -= got;
+    }
+    
+    free(text);
+    freeSyncIndex(&index);
+}
+
+/** A batch of files being uncompressed in parallel. */
+typedef struct {
+  /** The wordlist used for decoding. */
+  WordList *wordList;
+
+  /** The files. */
+  BatchFile *files;
+} FileBatch;
+
+/**
+ * Uncompresses the whole of a block-framed file into one buffer.
+ *
+ * @param wordList A pointer to the wordlist
+ * @param data The contents of the file
+ * @param index The index of its blocks
+ * @param total Set to the number of chars
+ * @return The chars, or NULL if the file isn't valid
+ */
+char *decodeWholeBlocks(WordList *wordList, const unsigned char *data,
+                        BlockIndex *index, size_t *total)
+{
+    *total = index->rawOffsets[index->count];
+    char *text = (char *)malloc(*total + 1);
+    if (!text) {
+        return NULL;
+    }
+    
+    for (int b = 0; b < index->count; b++) {
+        size_t rawLen = index->rawOffsets[b + 1] - index->rawOffsets[b];
+        if (decodeBlock(wordList, data + index->packedOffsets[b],
+                        index->packedOffsets[b + 1] - index->packedOffsets[b],
+                        index->codeBits, index->huffman,
+                        text + index->rawOffsets[b], rawLen, NULL) != rawLen) {
+            free(text);
+            return NULL;
+        }
+    }
+    return text;
+}
+
+/**
+ * Uncompresses one file of a batch, recording what went wrong instead
+ * of exiting.  Batches are for lots of small files, so each is read in
+ * whole.
+ *
+ * @param arg The batch
+ * @param job The number of the file
+ */
+void unpackFileJob(void *arg, int job)
+{
+    FileBatch *batch = (FileBatch *)arg;
+    BatchFile *file = batch->files + job;
+    WordList *wordList = batch->wordList;
+    
+    size_t len;
+    unsigned char *data = (unsigned char *)readWholeFile(file->input, &len);
+    if (!data) {
+        snprintf(file->message, BATCH_MESSAGE, BATCH_FILE_ERROR, file->input);
+        return;
+    }
+    
+    // Decode it the way unpack would, as blocks or as one stream
+    char *text = NULL;
+    size_t total = 0;
+    const char *problem = NULL;
+    BlockIndex index;
+    if (readBlockIndex(data, len, &index)) {
+        if (wordList->len > 1 << index.codeBits) {
+            problem = INVAL_WORD_FILE;
+        } else if (!(text = decodeWholeBlocks(wordList, data, &index, &total))) {
+            problem = INVAL_BLOCKS;
+        }
+        freeBlockIndex(&index);
+    } else if (hasBlockMagic(data, len)) {
+        problem = INVAL_BLOCKS;
+    } else if (wordList->len > 1 << BITS_PER_CODE) {
+        problem = INVAL_WORD_FILE;
+    } else {
+        uint16_t *codes = (uint16_t *)malloc((len * BITS_PER_BYTE / BITS_PER_CODE + 1)
+                                             * sizeof(uint16_t));
+        size_t n = readCodes(data, len, BITS_PER_CODE, codes);
+        text = (char *)malloc(n * WORD_MAX + WORD_COPY);
+        total = expandCodes(wordList, codes, n, text);
+        free(codes);
+    }
+    
+    if (problem) {
+        snprintf(file->message, BATCH_MESSAGE, "%s", problem);
+    } else if (writeWholeFile(file->output, text, total)) {
+        file->ok = true;
+    } else {
+        snprintf(file->message, BATCH_MESSAGE, BATCH_WRITE_ERROR, file->output);
+    }
+    
+    free(data);
+    free(text);
+}
+
+/**
+ * Uncompresses every file in a batch list.
+ *
+ * @param wordList A pointer to the wordlist
+ * @param list The name of the batch list
+ * @param threads The number of threads to uncompress with
+ * @return The number of files that failed
+ */
+int unpackBatch(WordList *wordList, char *list, int threads)
+{
+    FileBatch batch;
+    int count;
+    batch.files = readBatchList(list, &count);
+    if (!batch.files) {
+        error(INVAL_BATCH);
+    }
+    batch.wordList = wordList;
+    
+    ThreadPool *pool = makeThreadPool(threads);
+    runJobs(pool, unpackFileJob, &batch, count);
+    freeThreadPool(pool);
+    
+    int failed = reportBatch(batch.files, count);
+    freeBatchList(batch.files, count);
+    return failed;
+}
+
 /**
  * Takes two files as parameters. One to uncompress, and the output.
  * Optionally, a third file can be listed, the alternate word list.
@@ -43,8 +716,69 @@ int main( int argc, char *argv[] )
 {
     char *wordFile = "words.txt";
     
-    // If args are not correct
-    if (argc != CMD_ARGS && argc != (CMD_ARGS + 1)) {
+    // Pull out any options, leaving just the file names
+    bool throughput = false;
+    bool pipeline = false;
+    char *batchList = NULL;
+    bool showStats = false;
+    bool json = false;
+    int threads = processorCount();
+    bool range = false;
+    char *syncFile = NULL;
+    unsigned long start = 0;
+    unsigned long length = 0;
+    char extra;
+    int count = 1;
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], THROUGHPUT_OPT) == 0) {
+            throughput = true;
+        } else if (strcmp(argv[i], PIPELINE_OPT) == 0) {
+            pipeline = true;
+        } else if (strcmp(argv[i], STATS_OPT) == 0) {
+            showStats = true;
+        } else if (strcmp(argv[i], STATS_JSON_OPT) == 0) {
+            showStats = true;
+            json = true;
+        } else if (strcmp(argv[i], BATCH_OPT) == 0) {
+            if (i + 1 == argc) {
+                error(USAGE);
+            }
+            batchList = argv[++i];
+        } else if (strcmp(argv[i], THREADS_OPT) == 0) {
+            if (i + 1 == argc || (threads = atoi(argv[++i])) < 1) {
+                error(USAGE);
+            }
+        } else if (strcmp(argv[i], RANGE_OPT) == 0) {
+            if (i + 1 == argc
+                || sscanf(argv[++i], RANGE_FORMAT, &start, &length, &extra) != 2) {
+                error(USAGE);
+            }
+            range = true;
+        } else if (strcmp(argv[i], SYNC_INDEX_OPT) == 0) {
+            if (i + 1 == argc) {
+                error(USAGE);
+            }
+            syncFile = argv[++i];
+        } else {
+            argv[count++] = argv[i];
+        }
+    }
+    argc = count;
+    
+    // A batch has the file names in its list, so there's at most a word file
+    if (batchList) {
+        if (range || pipeline || showStats || syncFile || argc > 2) {
+            error(BATCH_USAGE);
+        }
+        WordList *wordList = readWordList(argc == 2 ? argv[1] : wordFile,
+                                          1 << MAX_CODE_BITS);
+        int failed = unpackBatch(wordList, batchList, threads);
+        freeWordList(wordList);
+        return failed ? EXIT_FAILURE : EXIT_SUCCESS;
+    }
+    
+    // If args are not correct.  A sync index is only used for a range.
+    if ((argc != CMD_ARGS && argc != (CMD_ARGS + 1)) || (syncFile && !range)) {
         error(USAGE);
     }
     // Set word file to alt list
@@ -52,33 +786,84 @@ int main( int argc, char *argv[] )
         wordFile = argv[CMD_ARGS];
     }
     
-    // Read WordList
-    WordList *wordList = readWordList( wordFile );
+    // Read WordList.  We don't know how wide the codes are yet, so it
+    // can be as big as the widest codes allow.
+    WordList *wordList = readWordList( wordFile, 1 << MAX_CODE_BITS );
     
     // Read in filenames
-    FILE *input = fopen(argv[1], "rb");
-    FILE *output = fopen(argv[2], "w");
+    FILE *input = openFile(argv[1], "rb", stdin);
+    FILE *output = openFile(argv[2], "w", stdout);
     
-    // Errors for not able to open file
-    if (!input) {
-        fprintf(stderr, FILE_ERROR, argv[1]);
-        error(USAGE);
+    Stats runStats;
+    if (showStats) {
+        initStats(&runStats);
+        stats = &runStats;
     }
-    if (!output) {
-        fprintf(stderr, FILE_ERROR, argv[2]);
-        error(USAGE);
+    
+    // Map the input if we can.  Otherwise look at how it starts: a
+    // block-framed file is read into memory so its index can be found,
+    // and anything else is read a piece at a time after what's been read.
+    size_t mappedLen = 0;
+    const unsigned char *mapped = mapFile(input, &mappedLen);
+    unsigned char *readIn = NULL;
+    unsigned char magic[MAGIC_LEN];
+    const unsigned char *prefix = NULL;
+    size_t prefixLen = 0;
+    if (!mapped && !syncFile) {
+        prefix = magic;
+        prefixLen = fread(magic, 1, MAGIC_LEN, input);
+        if (prefixLen == MAGIC_LEN && memcmp(magic, BLOCK_MAGIC, MAGIC_LEN) == 0) {
+            readIn = readFile(input, magic, prefixLen, &mappedLen);
+            mapped = prefix = readIn;
+            prefixLen = mappedLen;
+        }
     }
     
-    // Create the things to send to readCode
-    PendingBits pending = {0, 0};
-    int code;
+    BlockIndex index;
+    if (syncFile) {
+        if (wordList->len > 1 << BITS_PER_CODE) {
+            error(INVAL_WORD_FILE);
+        }
+        unpackSyncRange(wordList, input, output, syncFile, start, length);
+    } else if (mapped && readBlockIndex(mapped, mappedLen, &index)) {
+        if (wordList->len > 1 << index.codeBits) {
+            error(INVAL_WORD_FILE);
+        }
+        uint64_t end = range && length < UINT64_MAX - start ? start + length : UINT64_MAX;
+        unpackBlocks(wordList, output, mapped, &index, start, end, threads);
+        freeBlockIndex(&index);
+    } else if (mapped && hasBlockMagic(mapped, mappedLen)) {
+        error(INVAL_BLOCKS);
+    } else if (range) {
+        error(RANGE_ERROR);
+    } else {
+        if (wordList->len > 1 << BITS_PER_CODE) {
+            error(INVAL_WORD_FILE);
+        }
+        if (pipeline) {
+            unpackPipelined(wordList, input, prefix, prefixLen, output);
+        } else {
+            unpackStream(wordList, input, output, mapped, mappedLen,
+                         prefix, prefixLen);
+        }
+    }
     
-    // Read the code
-    while ((code = readCode(&pending, input)) != -1) {
-        // Output
-        fprintf(output, "%s", wordList->words[code]);
+    if (stats) {
+        reportStats(stats, wordList, json, stderr);
+        freeStats(stats);
     }
     
+    if (throughput) {
+        double seconds = decodeTime;
+        fprintf(stderr, THROUGHPUT, decodedBytes, seconds,
+                seconds > 0 ? decodedBytes / MEGABYTE / seconds : 0.0);
+    }
+    
+    if (readIn) {
+        free(readIn);
+    } else if (mapped) {
+        munmap((void *)mapped, mappedLen);
+    }
     // Free memory
     freeWordList(wordList);
     fclose(input);
@@ -5,10 +5,18 @@
  * Portion of the program that does the actual handling of the
  * WordList
  */
+
+#define _POSIX_C_SOURCE 200809L
+
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <stdbool.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
 
 #include "wordlist.h"
 
@@ -29,8 +37,16 @@
 #define VALID_MAX '~'
 /** Initial size. */
 #define INIT_SIZE 5
-/** Max number of words in a word file. */
-#define NUM_WORDS_MAX 414
+/** Number of chars checked together by findInvalidChar(). */
+#define CHECK_BLOCK 32
+/** Bit for a char in its word of validMap. */
+#define CHAR_MASK( ch ) ( (uint64_t)1 << ( (ch) & 63 ) )
+/** Version of the compiled image format. */
+#define IMAGE_VERSION 2
+/** Value stored in an image to check it was written on a similar machine. */
+#define IMAGE_CHECK 0x01020304
+/** Alignment of each array in an image. */
+#define IMAGE_ALIGN 8
 
 /**
  * Compares two words lexicographically , and returns negative if
@@ -49,6 +65,28 @@ int compareWords(const void *a, const void *b)
     return strncmp(ia, ib, WORD_MAX);
 }
 
+/** One bit for each of the 256 byte values, set if it's a valid char.
+    The control chars and VALID_MIN are in the first word, VALID_MAX in
+    the second, and nothing above 127 is valid. */
+static const uint64_t validMap[ 4 ] = {
+    CHAR_MASK( VALID_TAB ) | CHAR_MASK( VALID_NL ) | CHAR_MASK( VALID_RET )
+        | ~( CHAR_MASK( VALID_MIN ) - 1 ),
+    CHAR_MASK( VALID_MAX + 1 ) - 1,
+    0,
+    0
+};
+
+/**
+ * Returns 1 if the byte is a valid char, or 0 if it isn't.
+ *
+ * @param ch The byte
+ * @return 1 if it's valid
+ */
+static inline uint64_t validBit( unsigned char ch )
+{
+    return validMap[ ch >> 6 ] >> ( ch & 63 ) & 1;
+}
+
 /**
  * Returns true if the char is valid
  *
@@ -57,17 +95,57 @@ int compareWords(const void *a, const void *b)
  */
 bool validChar( char ch )
 {
-    if (ch == VALID_TAB) {
-        return true;
-    } else if (ch == VALID_RET) {
-        return true;
-    } else if (ch == VALID_NL) {
-        return true;
-    } else if (ch >= VALID_MIN && ch <= VALID_MAX) {
-        return true;
-    } else {
-        return false;
+    return validBit( (unsigned char)ch );
+}
+
+/**
+ * Finds the first char in a buffer that isn't valid.
+ *
+ * @param in The chars being checked
+ * @param len The number of chars
+ * @return The index of the first invalid char, or len if they're all valid
+ */
+size_t findInvalidChar( const char *in, size_t len )
+{
+    const unsigned char *bytes = (const unsigned char *)in;
+
+    // Whole blocks are checked without a branch for each char, and the
+    // first one with an invalid char is searched again below.
+    size_t i = 0;
+    for (; i + CHECK_BLOCK <= len; i += CHECK_BLOCK) {
+#ifdef __SSE2__
+        // Bytes are signed here, so the ones above 127 fail the range test
+        const __m128i below = _mm_set1_epi8(VALID_MIN - 1);
+        const __m128i above = _mm_set1_epi8(VALID_MAX + 1);
+        int valid = 0xFFFF;
+        for (int j = 0; j < CHECK_BLOCK; j += sizeof(__m128i)) {
+            __m128i v = _mm_loadu_si128((const __m128i *)(bytes + i + j));
+            __m128i ok = _mm_and_si128(_mm_cmpgt_epi8(v, below),
+                                       _mm_cmplt_epi8(v, above));
+            ok = _mm_or_si128(ok, _mm_cmpeq_epi8(v, _mm_set1_epi8(VALID_TAB)));
+            ok = _mm_or_si128(ok, _mm_cmpeq_epi8(v, _mm_set1_epi8(VALID_NL)));
+            ok = _mm_or_si128(ok, _mm_cmpeq_epi8(v, _mm_set1_epi8(VALID_RET)));
+            valid &= _mm_movemask_epi8(ok);
+        }
+        if (valid != 0xFFFF) {
+            break;
+        }
+#else
+        uint64_t valid = 1;
+        for (int j = 0; j < CHECK_BLOCK; j++) {
+            valid &= validBit(bytes[i + j]);
+        }
+        if (!valid) {
+            break;
+        }
+#endif
     }
+    for (; i < len; i++) {
+        if (!validBit(bytes[i])) {
+            return i;
+        }
+    }
+    return len;
 }
 
 /**
@@ -83,43 +161,166 @@ void addChar(WordList *list, unsigned char ch)
         (Word *)realloc(list->words, list->capacity * sizeof(Word));
     }
     
-    // Assign the char
-    char term = '\0';
-    char w[WORD_MAX + 1];
-    sprintf(w, "%c%c", ch, term);
-    
-    // Assign to rear
-    strncpy(list->words[list->len], w, 1);
+    // Assign to rear as a one-character word
+    list->words[list->len][0] = ch;
+    list->words[list->len][1] = '\0';
     (list->len)++;
 }
 
 /**
- * Builds the WordList from one pointer to a string.
+ * Checks that an array of count elements of the given size at offset
+ * lies inside an image.
  *
- * @param fname a pointer to the string
- * @return The WordList
+ * @param image The image header
+ * @param offset Offset of the array
+ * @param count Number of elements
+ * @param size Size of each element
+ * @return true if the array fits
  */
-WordList *readWordList( char const *fname )
+static bool inImage(WordImage *image, uint64_t offset, int32_t count,
+                    size_t size)
 {
-    // Try to read in file
-    FILE *wf = fopen(fname, "r");
-    // If file not found, print error and exit.
-    if (!wf) {
-        // Print error message to stderr
-        fprintf(stderr, WORD_FILE_ERROR, fname);
-        // Exit unsuccessfully
-        exit(EXIT_FAILURE);
+    return count >= 0 && offset % IMAGE_ALIGN == 0 && offset <= image->size
+        && (uint64_t)count * size <= image->size - offset;
+}
+
+/**
+ * Checks that a node index from an image is -1 or a node in it.
+ *
+ * @param image The image header
+ * @param node The node index
+ * @return true if it's valid
+ */
+static bool validNode(WordImage *image, int node)
+{
+    return node >= -1 && node < image->nodeCount;
+}
+
+/**
+ * Checks what the arrays of an image hold, once they're known to be
+ * inside it, so nothing that follows them can go outside an array.
+ * Every node, edge and root entry has to lead to a node, every node's
+ * edges have to be in the edge arrays and its code has to be a word,
+ * every word has to be in the pool with padding after it, and every
+ * valid char has to be a word, so bestCode() always finds one.
+ *
+ * @param image The image header
+ * @return true if the contents are valid
+ */
+static bool validImageContents(WordImage *image)
+{
+    char *base = (char *)image;
+    TrieNode *nodes = (TrieNode *)(base + image->nodesOffset);
+    int *edgeTargets = (int *)(base + image->edgeTargetsOffset);
+    WordSpan *spans = (WordSpan *)(base + image->spansOffset);
+    
+    for (int i = 0; i <= UCHAR_MAX; i++) {
+        if (!validNode(image, image->rootNext[i])
+            || (validBit(i) && (image->rootNext[i] < 0
+                                || nodes[image->rootNext[i]].code < 0))) {
+            return false;
+        }
+    }
+    for (int i = 0; i < image->edgeCount; i++) {
+        if (!validNode(image, edgeTargets[i])) {
+            return false;
+        }
+    }
+    for (int i = 0; i < image->nodeCount; i++) {
+        TrieNode *node = nodes + i;
+        if (node->firstEdge < 0 || node->edgeCount < 0
+            || node->edgeCount > image->edgeCount - node->firstEdge
+            || node->code < -1 || node->code >= image->len) {
+            return false;
+        }
+    }
+    for (int i = 0; i < image->spanCount; i++) {
+        if (spans[i].offset < 0 || spans[i].length < 0 || spans[i].length > WORD_MAX
+            || spans[i].offset > image->poolSize - WORD_COPY - spans[i].length) {
+            return false;
+        }
+    }
+    return true;
+}
+
+/**
+ * Maps a compiled word list image into memory and makes a WordList that
+ * uses its arrays directly.
+ *
+ * @param wf The image file, opened for reading.  It's closed when this
+ * returns.
+ * @param maxCodes The number of codes available
+ * @return The WordList, or NULL if the image isn't valid, or has too
+ * many words for the codes available
+ */
+static WordList *mapWordImage(FILE *wf, int maxCodes)
+{
+    struct stat st;
+    void *data = MAP_FAILED;
+    if (fstat(fileno(wf), &st) == 0 && st.st_size >= sizeof(WordImage)) {
+        data = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fileno(wf), 0);
+    }
+    fclose(wf);
+    if (data == MAP_FAILED) {
+        return NULL;
     }
     
+    // Make sure the image is one we can use, every array is inside it,
+    // and what they hold is consistent
+    WordImage *image = (WordImage *)data;
+    if (image->version != IMAGE_VERSION || image->check != IMAGE_CHECK
+        || image->size != st.st_size || image->len > maxCodes
+        || image->spanCount < maxCodes || image->nodeCount < 1
+        || !inImage(image, image->poolOffset, image->poolSize, 1)
+        || !inImage(image, image->spansOffset, image->spanCount, sizeof(WordSpan))
+        || !inImage(image, image->nodesOffset, image->nodeCount, sizeof(TrieNode))
+        || !inImage(image, image->edgeCharsOffset, image->edgeCount, 1)
+        || !inImage(image, image->edgeTargetsOffset, image->edgeCount, sizeof(int))
+        || !validImageContents(image)) {
+        munmap(data, st.st_size);
+        return NULL;
+    }
+    
+    // Point the list at the arrays in the image
+    char *base = (char *)data;
+    WordList *list = (WordList *)malloc(sizeof(WordList));
+    list->len = image->len;
+    list->capacity = image->len;
+    list->words = NULL;
+    list->pool = base + image->poolOffset;
+    list->poolSize = image->poolSize;
+    list->spans = (WordSpan *)(base + image->spansOffset);
+    list->spanCount = image->spanCount;
+    list->nodes = (TrieNode *)(base + image->nodesOffset);
+    list->nodeCount = image->nodeCount;
+    list->edgeChars = (unsigned char *)(base + image->edgeCharsOffset);
+    list->edgeTargets = (int *)(base + image->edgeTargetsOffset);
+    list->edgeCount = image->edgeCount;
+    memcpy(list->rootNext, image->rootNext, sizeof(list->rootNext));
+    list->image = data;
+    list->imageLen = st.st_size;
+    
+    return list;
+}
+
+/**
+ * Makes a WordList holding just the single chars.
+ *
+ * @return The WordList
+ */
+WordList *makeWordList()
+{
     // Create the WordList {len, capacity, *word}
     WordList *list = (WordList *)malloc(sizeof(WordList));
     list->len = 0;
     list->capacity = INIT_SIZE;
     list->words = (Word *)malloc(sizeof(Word) * list->capacity);
-    
-    // Variables for temp storage
-    int num = 0;
-    char w[WORD_MAX + 1];
+    list->pool = NULL;
+    list->spans = NULL;
+    list->image = NULL;
+    list->nodes = NULL;
+    list->edgeChars = NULL;
+    list->edgeTargets = NULL;
     
     // Add the 98 chars
     addChar(list, '\t');
@@ -129,17 +330,98 @@ WordList *readWordList( char const *fname )
         addChar(list, i);
     }
     
-    // Counter variable
-    int count = 0;
-    // Read in word list
-    while (fscanf(wf, "%d %s", &num, w) == 2) {
-        // Increment counter
-        count++;
-        // If the number of chars is greater than expected, exit
-        if (num > WORD_MAX || count > NUM_WORDS_MAX) {
-            fprintf(stderr, INVAL_WORD_FILE);
+    return list;
+}
+
+/**
+ * Adds a word to the end of the given wordList.
+ *
+ * @param list A pointer to the WordList
+ * @param word The chars of the word, which don't need a null terminator
+ * @param len The length of the word, from 1 to WORD_MAX
+ */
+void addWord(WordList *list, char const *word, int len)
+{
+    if (list->len == list->capacity - 1) {
+        list->capacity *= 2;
+        list->words = (Word *)realloc(list->words,
+                                      list->capacity * sizeof(Word));
+    }
+    
+    memcpy(list->words[list->len], word, len);
+    list->words[list->len][len] = '\0';
+    (list->len)++;
+}
+
+/**
+ * Sorts the words in the given wordList and builds the index used to
+ * find matches and the pool used to write words out.  After this, words
+ * can only be read from the pool, and no more can be added.
+ *
+ * @param list A pointer to the WordList
+ * @param maxCodes The number of codes available
+ */
+void indexWordList(WordList *list, int maxCodes)
+{
+    // Sort the list
+    // void *base, size num items, size in bytes of each element, cmpr
+    qsort(list->words, list->len, sizeof(Word), compareWords);
+    
+    buildTrie(list);
+    buildPool(list, maxCodes);
+    
+    // Everything after this uses the pool
+    free(list->words);
+    list->words = NULL;
+}
+
+/**
+ * Builds the WordList from one pointer to a string.  The list, including
+ * the single chars, can't have more words than there are codes.
+ *
+ * @param fname a pointer to the string
+ * @param maxCodes The number of codes available, 2 to the power of the
+ * number of bits per code
+ * @return The WordList
+ */
+WordList *loadWordList( char const *fname, int maxCodes,
+                        WordListStatus *status )
+{
+    // Try to read in file
+    FILE *wf = fopen(fname, "r");
+    if (!wf) {
+        *status = WORD_FILE_MISSING;
+        return NULL;
+    }
+    
+    // Compiled images are used as they are
+    *status = WORD_FILE_INVALID;
+    char magic[IMAGE_MAGIC_LEN];
+    if (fread(magic, 1, IMAGE_MAGIC_LEN, wf) == IMAGE_MAGIC_LEN
+        && memcmp(magic, IMAGE_MAGIC, IMAGE_MAGIC_LEN) == 0) {
+        WordList *list = mapWordImage(wf, maxCodes);
+        if (list) {
+            *status = WORD_FILE_OK;
+        }
+        return list;
+    }
+    rewind(wf);
+    
+    // Create the WordList, starting with the single chars
+    WordList *list = makeWordList();
+    
+    // Variables for temp storage
+    int num = 0;
+    
+    // Read in word list.  Each word is its length, a single space, then
+    // exactly that many characters, which may include spaces or newlines.
+    while (fscanf(wf, "%d", &num) == 1) {
+        // If the number of chars is greater than expected, or there are
+        // no codes left, give up
+        if (num < 1 || num > WORD_MAX || list->len == maxCodes) {
             freeWordList(list);
-            exit(EXIT_FAILURE);
+            fclose(wf);
+            return NULL;
         }
         // Resize if needed
         if (list->len == list->capacity - 1) {
@@ -148,26 +430,258 @@ WordList *readWordList( char const *fname )
                                           list->capacity * sizeof(Word));
         }
         // Assign to rear
-        strncpy(list->words[list->len], w, num);
+        char *w = list->words[list->len];
+        if (fgetc(wf) != ' ' || fread(w, 1, num, wf) != num) {
+            freeWordList(list);
+            fclose(wf);
+            return NULL;
+        }
+        w[num] = '\0';
         (list->len)++;
     }
+    fclose(wf);
     
-    // Sort the list
-    // void *base, size num items, size in bytes of each element, cmpr
-    qsort(list->words, list->len, sizeof(Word), compareWords);
+    indexWordList(list, maxCodes);
+    
+    // Return the pointer to WordList
+    *status = WORD_FILE_OK;
+    return list;
+}
+
+WordList *readWordList( char const *fname, int maxCodes )
+{
+    WordListStatus status;
+    WordList *list = loadWordList(fname, maxCodes, &status);
     
-    /**
-    for (int i = 0; i < list->len; i++) {
-        printf("\'%s\'\n", list->words[i]);
+    // If file not found or not valid, print error and exit.
+    if (status == WORD_FILE_MISSING) {
+        fprintf(stderr, WORD_FILE_ERROR, fname);
+        exit(EXIT_FAILURE);
+    } else if (status == WORD_FILE_INVALID) {
+        fprintf(stderr, INVAL_WORD_FILE);
+        exit(EXIT_FAILURE);
     }
-    */
     
-    // Return the pointer to WordList
     return list;
 }
 
 /**
- * Returns the best code for the sequence of chars.
+ * Returns the code bsearch() finds for the given word.  The word list
+ * may contain duplicates, and the trie has to give the same code the
+ * original binary search did so compressed files stay the same.
+ *
+ * @param list A pointer to the sorted WordList
+ * @param word The word being looked up
+ * @return The code for word
+ */
+static int searchCode(WordList *list, char const *word)
+{
+    Word *key = (Word *)bsearch(word, list->words, list->len,
+                                sizeof(Word), compareWords);
+    return key - list->words;
+}
+
+/**
+ * Adds the children of the given trie node, and all of their
+ * descendants.  Every word in the range [lo, hi) of the sorted list
+ * starts with the depth characters on the path to node.
+ *
+ * @param list A pointer to the sorted WordList
+ * @param node The node getting children
+ * @param lo Index of the first word below node
+ * @param hi Index past the last word below node
+ * @param depth Length of the path to node
+ */
+static void addChildren(WordList *list, int node, int lo, int hi, int depth)
+{
+    // Words ending at this node sort before any that continue past it
+    while (lo < hi && list->words[lo][depth] == '\0') {
+        lo++;
+    }
+    
+    // Reserve a contiguous run of edges, one for each distinct next char
+    int count = 0;
+    for (int i = lo; i < hi; i++) {
+        if (i == lo || list->words[i][depth] != list->words[i - 1][depth]) {
+            count++;
+        }
+    }
+    int edge = list->edgeCount;
+    list->nodes[node].firstEdge = edge;
+    list->nodes[node].edgeCount = count;
+    list->edgeCount += count;
+    
+    // Make a child for each group of words sharing the next char
+    for (int i = lo; i < hi; ) {
+        unsigned char ch = list->words[i][depth];
+        int j = i + 1;
+        while (j < hi && (unsigned char)list->words[j][depth] == ch) {
+            j++;
+        }
+        
+        int child = list->nodeCount++;
+        list->nodes[child].code = -1;
+        if (list->words[i][depth + 1] == '\0') {
+            list->nodes[child].code = searchCode(list, list->words[i]);
+        }
+        list->edgeChars[edge] = ch;
+        list->edgeTargets[edge] = child;
+        edge++;
+        
+        addChildren(list, child, i, j, depth + 1);
+        i = j;
+    }
+}
+
+/**
+ * Builds the prefix trie used by bestCode() over the sorted words
+ * in the given wordList.
+ *
+ * @param wordList A pointer to the sorted wordlist
+ */
+void buildTrie( WordList *wordList )
+{
+    // Every character of every word adds at most one node and one edge
+    int total = 0;
+    for (int i = 0; i < wordList->len; i++) {
+        total += strlen(wordList->words[i]);
+    }
+    wordList->nodes = (TrieNode *)malloc((total + 1) * sizeof(TrieNode));
+    wordList->edgeChars = (unsigned char *)malloc(total + 1);
+    wordList->edgeTargets = (int *)malloc((total + 1) * sizeof(int));
+    wordList->nodeCount = 1;
+    wordList->edgeCount = 0;
+    
+    // The root is the empty string, which isn't a word
+    wordList->nodes[0].code = -1;
+    addChildren(wordList, 0, 0, wordList->len, 0);
+    
+    // Direct lookup table for the children of the root
+    for (int i = 0; i <= UCHAR_MAX; i++) {
+        wordList->rootNext[i] = -1;
+    }
+    TrieNode *root = wordList->nodes;
+    for (int e = root->firstEdge; e < root->firstEdge + root->edgeCount; e++) {
+        wordList->rootNext[wordList->edgeChars[e]] = wordList->edgeTargets[e];
+    }
+}
+
+/**
+ * Builds the string pool and the table of word positions in it for
+ * the sorted words in the given wordList.
+ *
+ * @param wordList A pointer to the sorted wordlist
+ * @param maxCodes The number of entries in the table, at least as many
+ * as there are words.  Entries past the end of the list are empty words.
+ */
+void buildPool( WordList *wordList, int maxCodes )
+{
+    // Table entries for every code, even ones with no word
+    wordList->spans = (WordSpan *)calloc(maxCodes, sizeof(WordSpan));
+    wordList->spanCount = maxCodes;
+    
+    // Lay the words out one after another
+    int total = 0;
+    for (int i = 0; i < wordList->len; i++) {
+        wordList->spans[i].offset = total;
+        wordList->spans[i].length = strlen(wordList->words[i]);
+        total += wordList->spans[i].length;
+    }
+    wordList->poolSize = total + WORD_COPY;
+    wordList->pool = (char *)calloc(wordList->poolSize, 1);
+    for (int i = 0; i < wordList->len; i++) {
+        memcpy(wordList->pool + wordList->spans[i].offset,
+               wordList->words[i], wordList->spans[i].length);
+    }
+}
+
+/**
+ * Stores the words for a sequence of codes one after another in the
+ * given buffer.  The words aren't null terminated.
+ *
+ * @param wordList A pointer to the wordlist
+ * @param codes The codes to expand
+ * @param n The number of codes
+ * @param out Buffer for the words, with room for n * WORD_MAX chars
+ * plus WORD_COPY chars of padding
+ * @return The number of chars stored in out
+ */
+size_t expandCodes( WordList *wordList, const uint16_t *codes, size_t n,
+                    char *out )
+{
+    char *start = out;
+    const char *pool = wordList->pool;
+    const WordSpan *spans = wordList->spans;
+    
+    // Copy a fixed amount, then only move ahead by the word's length,
+    // so the next word overwrites the extra
+    for (size_t i = 0; i < n; i++) {
+        WordSpan span = spans[codes[i]];
+        memcpy(out, pool + span.offset, WORD_COPY);
+        out += span.length;
+    }
+    
+    return out - start;
+}
+
+/**
+ * Stores the words for a sequence of codes after the chars already in
+ * a buffer, without going past the end of it.
+ *
+ * @param wordList A pointer to the wordlist
+ * @param codes The codes to expand
+ * @param n The number of codes
+ * @param out The buffer
+ * @param total The number of chars already in out, which is updated
+ * @param cap The size of out
+ * @return false if a word didn't fit, in which case the words before it
+ * are stored
+ */
+bool copyWords( WordList *wordList, const uint16_t *codes, size_t n,
+                char *out, size_t *total, size_t cap )
+{
+    // Copy quickly while even the longest words would fit with padding,
+    // then carefully near the end of the buffer
+    if (*total + n * WORD_MAX + WORD_COPY <= cap) {
+        *total += expandCodes(wordList, codes, n, out + *total);
+        return true;
+    }
+    for (size_t i = 0; i < n; i++) {
+        WordSpan span = wordList->spans[codes[i]];
+        if (*total + span.length > cap) {
+            return false;
+        }
+        memcpy(out + *total, wordList->pool + span.offset, span.length);
+        *total += span.length;
+    }
+    return true;
+}
+
+/**
+ * Returns the child of node reached by following the edge for ch.
+ *
+ * @param wordList A pointer to the wordlist
+ * @param node The node being left
+ * @param ch The character on the edge
+ * @return The child node, or -1 if there isn't one
+ */
+static int trieChild( WordList *wordList, int node, unsigned char ch )
+{
+    TrieNode *n = wordList->nodes + node;
+    unsigned char const *chars = wordList->edgeChars + n->firstEdge;
+    
+    // Edges are sorted by char, so we can stop early
+    for (int e = 0; e < n->edgeCount && chars[e] <= ch; e++) {
+        if (chars[e] == ch) {
+            return wordList->edgeTargets[n->firstEdge + e];
+        }
+    }
+    return -1;
+}
+
+/**
+ * Returns the best code for the sequence of chars.  This is the code
+ * for the longest word in the list that matches the start of str.
  *
  * @param wordList A pointer to the wordlist
  * @param str The sequence of characters being searched for
@@ -175,30 +689,120 @@ WordList *readWordList( char const *fname )
  */
 int bestCode( WordList *wordList, char const *str )
 {
-    // Char to hold the string being searched for
-    char keyStr[WORD_MAX + 1];
+    int best = -1;
     
-    // Search while not matched
-    Word *key = NULL;
+    // Walk down the trie, remembering the last word we passed through.
+    // There's no edge for the null terminator, so this stops at the end
+    // of str.
+    int node = wordList->rootNext[(unsigned char)str[0]];
+    for (int i = 1; node >= 0; i++) {
+        if (wordList->nodes[node].code >= 0) {
+            best = wordList->nodes[node].code;
+        }
+        if (!str[i]) {
+            break;
+        }
+        node = trieChild(wordList, node, str[i]);
+    }
     
-    for (int i = WORD_MAX; i > 0; i--) {
-        // Check the next string
-        strncpy(keyStr, str, i);
-        keyStr[i] = '\0';
-        
-        // Try to get the key
-        key = (Word *)bsearch(keyStr, wordList->words, wordList->len,
-                              sizeof(Word), compareWords);
-        // printf("The key is: %lu\n", (key - wordList->words) / sizeof(Word));
-        
-        if (key != NULL) {
-            // Return the index of the string
-            return (key - wordList->words); // / sizeof(Word);
+    return best;
+}
+
+/**
+ * Finds every word in the list that matches the start of str, looking
+ * at no more than len chars.
+ *
+ * @param wordList A pointer to the wordlist
+ * @param str The sequence of characters being searched for
+ * @param len The number of characters that can be matched
+ * @param codes Array with room for WORD_MAX codes, set to the code
+ * matching each length, or -1
+ * @return The length of the longest match
+ */
+int findMatches( WordList *wordList, char const *str, int len, int *codes )
+{
+    int longest = 0;
+    
+    // Same walk as bestCode(), but recording every word along the way
+    int node = len > 0 ? wordList->rootNext[(unsigned char)str[0]] : -1;
+    for (int i = 1; node >= 0; i++) {
+        codes[i - 1] = wordList->nodes[node].code;
+        if (codes[i - 1] >= 0) {
+            longest = i;
+        }
+        if (i == len || !str[i]) {
+            break;
         }
+        node = trieChild(wordList, node, str[i]);
     }
     
-    // otherwise, return -1
-    return -1;
+    return longest;
+}
+
+/**
+ * Adds an array to the image being laid out, at the next aligned offset.
+ *
+ * @param image The image header
+ * @param size The size of the array
+ * @return The offset of the array
+ */
+static uint64_t placeArray(WordImage *image, size_t size)
+{
+    uint64_t offset = (image->size + IMAGE_ALIGN - 1) / IMAGE_ALIGN * IMAGE_ALIGN;
+    image->size = offset + size;
+    return offset;
+}
+
+/**
+ * Writes a compiled image of the given wordList, which readWordList()
+ * can load without parsing, sorting or building anything.
+ *
+ * @param wordList A pointer to the wordlist
+ * @param fname The name of the image file
+ * @return false if the file couldn't be written
+ */
+bool writeWordImage( WordList *wordList, char const *fname )
+{
+    // Fill in the header, laying out the arrays after it
+    WordImage image;
+    memset(&image, 0, sizeof(image));
+    memcpy(image.magic, IMAGE_MAGIC, IMAGE_MAGIC_LEN);
+    image.version = IMAGE_VERSION;
+    image.check = IMAGE_CHECK;
+    image.len = wordList->len;
+    image.poolSize = wordList->poolSize;
+    image.spanCount = wordList->spanCount;
+    image.nodeCount = wordList->nodeCount;
+    image.edgeCount = wordList->edgeCount;
+    memcpy(image.rootNext, wordList->rootNext, sizeof(image.rootNext));
+    
+    image.size = sizeof(image);
+    image.poolOffset = placeArray(&image, wordList->poolSize);
+    image.spansOffset = placeArray(&image, wordList->spanCount * sizeof(WordSpan));
+    image.nodesOffset = placeArray(&image, wordList->nodeCount * sizeof(TrieNode));
+    image.edgeCharsOffset = placeArray(&image, wordList->edgeCount);
+    image.edgeTargetsOffset = placeArray(&image, wordList->edgeCount * sizeof(int));
+    
+    // Put the whole image together in memory, then write it out
+    char *data = (char *)calloc(image.size, 1);
+    memcpy(data, &image, sizeof(image));
+    memcpy(data + image.poolOffset, wordList->pool, wordList->poolSize);
+    memcpy(data + image.spansOffset, wordList->spans,
+           wordList->spanCount * sizeof(WordSpan));
+    memcpy(data + image.nodesOffset, wordList->nodes,
+           wordList->nodeCount * sizeof(TrieNode));
+    memcpy(data + image.edgeCharsOffset, wordList->edgeChars, wordList->edgeCount);
+    memcpy(data + image.edgeTargetsOffset, wordList->edgeTargets,
+           wordList->edgeCount * sizeof(int));
+    
+    FILE *fp = fopen(fname, "wb");
+    bool ok = fp && fwrite(data, 1, image.size, fp) == image.size;
+    if (fp && fclose(fp) != 0) {
+        ok = false;
+    }
+    free(data);
+    
+    return ok;
 }
 
 /**
@@ -208,8 +812,20 @@ int bestCode( WordList *wordList, char const *str )
  */
 void freeWordList( WordList *wordList )
 {
-    // Free the words array
+    // A compiled image just gets unmapped
+    if (wordList->image) {
+        munmap(wordList->image, wordList->imageLen);
+        free(wordList);
+        return;
+    }
+    
+    // Free the words array, if it's still there, the pool and the trie
     free(wordList->words);
+    free(wordList->pool);
+    free(wordList->spans);
+    free(wordList->nodes);
+    free(wordList->edgeChars);
+    free(wordList->edgeTargets);
     // Free the WordList
     free(wordList);
 }
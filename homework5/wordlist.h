@@ -10,6 +10,9 @@
 #define _WORDLIST_H_
 
 #include <stdbool.h>
+#include <limits.h>
+#include <stddef.h>
+#include <stdint.h>
 
 /** Maximum length of a word in wordlist. */
 #define WORD_MAX 20
@@ -33,10 +36,49 @@ int compareWords(const void *a, const void *b);
  */
 bool validChar( char ch );
 
+/**
+ * Finds the first char in a buffer that isn't valid.
+ *
+ * @param in The chars being checked
+ * @param len The number of chars
+ * @return The index of the first invalid char, or len if they're all valid
+ */
+size_t findInvalidChar( const char *in, size_t len );
+
 /** Word type, used to store elements of the word list,
     with room for a word of up to 20 characters. */
 typedef char Word[ WORD_MAX + 1 ];
 
+/** Number of bytes expandCodes() copies for every word, whatever its
+    length.  Copying a fixed amount is quicker than copying exactly
+    the right number of bytes, so the pool and the output both have
+    this much padding at the end. */
+#define WORD_COPY 32
+
+/** Where one word is stored in the string pool. */
+typedef struct {
+  /** Index of the word's first char in the pool. */
+  int offset;
+
+  /** Length of the word. */
+  int length;
+} WordSpan;
+
+/** One node of the prefix trie used to find the longest word matching
+    the start of a string.  The outgoing edges of a node are stored
+    contiguously, sorted by character, in the edge arrays of the WordList. */
+typedef struct {
+  /** Code of the word spelled by the path to this node, or -1 if
+      there's no such word. */
+  int code;
+
+  /** Index of this node's first outgoing edge. */
+  int firstEdge;
+
+  /** Number of outgoing edges. */
+  int edgeCount;
+} TrieNode;
+
 /** Representation for the whole wordlist.  It contains
     the list of words as a resizable, dynamically allocated
     array, along with supporting fields for resizing. */
@@ -47,11 +89,109 @@ typedef struct {
   /** Capacity of the wordlist, so we can know when we need to resize. */
   int capacity;
 
-  /** List of words.  Should be sorted lexicographically once the word list
-      has been read in. */
+  /** Words as they're added, in fixed size slots.  These are only
+      needed to sort the list and build the trie and pool, so
+      indexWordList() frees them and sets this to NULL. */
   Word *words;
+
+  /** All the words, one after another without null terminators,
+      followed by WORD_COPY bytes of padding.  Words are sorted
+      lexicographically. */
+  char *pool;
+
+  /** Size of the pool, including the padding. */
+  int poolSize;
+
+  /** Position of each word in the pool, indexed by code.  There's
+      an entry for every possible code, so a code read from a corrupt
+      file just gets an empty word. */
+  WordSpan *spans;
+
+  /** Number of entries in spans. */
+  int spanCount;
+
+  /** Nodes of the prefix trie built over the sorted words.  Node 0 is
+      the root. */
+  TrieNode *nodes;
+
+  /** Number of nodes in the trie. */
+  int nodeCount;
+
+  /** Character labelling each trie edge. */
+  unsigned char *edgeChars;
+
+  /** Node each trie edge leads to. */
+  int *edgeTargets;
+
+  /** Number of edges in the trie. */
+  int edgeCount;
+
+  /** Child of the root for every byte value, or -1 if there isn't one.
+      The root has an edge for every valid character, so it gets a
+      direct lookup table instead of a search through its edges. */
+  int rootNext[ UCHAR_MAX + 1 ];
+
+  /** Compiled image the arrays above point into, if the list was loaded
+      from one, or NULL if they were allocated separately. */
+  void *image;
+
+  /** Size of the mapped image. */
+  size_t imageLen;
 } WordList;
 
+/** Result of loading a word file. */
+typedef enum {
+  /** The word list was loaded. */
+  WORD_FILE_OK,
+
+  /** The word file couldn't be opened. */
+  WORD_FILE_MISSING,
+
+  /** The word file isn't valid, or has more words than there are
+      codes. */
+  WORD_FILE_INVALID
+} WordListStatus;
+
+/** Magic string at the start of a compiled word list image. */
+#define IMAGE_MAGIC "WPDC"
+
+/** Length of IMAGE_MAGIC. */
+#define IMAGE_MAGIC_LEN 4
+
+/** Header of a compiled word list image.  The image holds every array
+    of a WordList exactly as it is in memory, at the offsets given here,
+    so it can be mapped and used without any parsing.  Since it's a copy
+    of memory, an image can only be used on machines with the same byte
+    order and type sizes. */
+typedef struct {
+  /** IMAGE_MAGIC. */
+  char magic[ IMAGE_MAGIC_LEN ];
+
+  /** Version of the image format. */
+  uint32_t version;
+
+  /** A known value, used to check the byte order and type sizes match. */
+  uint32_t check;
+
+  /** Fields copied from the WordList. */
+  int32_t len;
+  int32_t poolSize;
+  int32_t spanCount;
+  int32_t nodeCount;
+  int32_t edgeCount;
+  int32_t rootNext[ UCHAR_MAX + 1 ];
+
+  /** Offsets of each array in the image. */
+  uint64_t poolOffset;
+  uint64_t spansOffset;
+  uint64_t nodesOffset;
+  uint64_t edgeCharsOffset;
+  uint64_t edgeTargetsOffset;
+
+  /** Size of the whole image. */
+  uint64_t size;
+} WordImage;
+
 /**
  * Adds the given char to the given wordList.
  *
@@ -61,15 +201,108 @@ typedef struct {
 void addChar(WordList *list, unsigned char ch);
 
 /**
- * Builds the WordList from one pointer to a string.
+ * Makes a WordList holding just the single chars.
+ *
+ * @return The WordList
+ */
+WordList *makeWordList();
+
+/**
+ * Adds a word to the end of the given wordList.
+ *
+ * @param list A pointer to the WordList
+ * @param word The chars of the word, which don't need a null terminator
+ * @param len The length of the word, from 1 to WORD_MAX
+ */
+void addWord(WordList *list, char const *word, int len);
+
+/**
+ * Sorts the words in the given wordList and builds the index used to
+ * find matches and the pool used to write words out.  The list can't
+ * have more than maxCodes words.
+ *
+ * @param list A pointer to the WordList
+ * @param maxCodes The number of codes available
+ */
+void indexWordList(WordList *list, int maxCodes);
+
+/**
+ * Builds the WordList from one pointer to a string, like readWordList(),
+ * but reports problems through status instead of exiting.
  *
  * @param fname a pointer to the string
+ * @param maxCodes The number of codes available
+ * @param status Set to WORD_FILE_OK, or the reason there's no list
+ * @return The WordList, or NULL if it couldn't be read
+ */
+WordList *loadWordList( char const *fname, int maxCodes,
+                        WordListStatus *status );
+
+/**
+ * Builds the WordList from one pointer to a string.  The list, including
+ * the single chars, can't have more words than there are codes.  The
+ * file can be a text word file, or an image written by writeWordImage(),
+ * which is mapped into memory and used as it is.  If the file can't be
+ * read or isn't valid, this prints an error and exits.
+ *
+ * @param fname a pointer to the string
+ * @param maxCodes The number of codes available, 2 to the power of the
+ * number of bits per code
  * @return The WordList
  */
-WordList *readWordList( char const *fname );
+WordList *readWordList( char const *fname, int maxCodes );
+
+/**
+ * Builds the prefix trie used by bestCode() over the sorted words
+ * in the given wordList.
+ *
+ * @param wordList A pointer to the sorted wordlist
+ */
+void buildTrie( WordList *wordList );
+
+/**
+ * Builds the string pool and the table of word positions in it for
+ * the sorted words in the given wordList.
+ *
+ * @param wordList A pointer to the sorted wordlist
+ * @param maxCodes The number of entries in the table, at least as many
+ * as there are words.  Entries past the end of the list are empty words.
+ */
+void buildPool( WordList *wordList, int maxCodes );
 
 /**
- * Returns the best code for the sequence of chars.
+ * Stores the words for a sequence of codes one after another in the
+ * given buffer.  The words aren't null terminated.
+ *
+ * @param wordList A pointer to the wordlist
+ * @param codes The codes to expand
+ * @param n The number of codes
+ * @param out Buffer for the words, with room for n * WORD_MAX chars
+ * plus WORD_COPY chars of padding
+ * @return The number of chars stored in out
+ */
+size_t expandCodes( WordList *wordList, const uint16_t *codes, size_t n,
+                    char *out );
+
+/**
+ * Stores the words for a sequence of codes after the chars already in
+ * a buffer, without going past the end of it.
+ *
+ * @param wordList A pointer to the wordlist
+ * @param codes The codes to expand
+ * @param n The number of codes
+ * @param out The buffer
+ * @param total The number of chars already in out, which is updated
+ * @param cap The size of out
+ * @return false if a word didn't fit, in which case the words before it
+ * are stored
+ */
+bool copyWords( WordList *wordList, const uint16_t *codes, size_t n,
+                char *out, size_t *total, size_t cap );
+
+/**
+ * Returns the best code for the sequence of chars.  This is the code
+ * for the longest word in the list that matches the start of str.
  *
  * @param wordList A pointer to the wordlist
  * @param str The sequence of characters being searched for
@@ -77,6 +310,30 @@ WordList *readWordList( char const *fname );
  */
 int bestCode( WordList *wordList, char const *str );
 
+/**
+ * Finds every word in the list that matches the start of str, looking
+ * at no more than len chars.
+ *
+ * @param wordList A pointer to the wordlist
+ * @param str The sequence of characters being searched for
+ * @param len The number of characters that can be matched
+ * @param codes Array with room for WORD_MAX codes.  Element i is set to
+ * the code for the word of length i + 1 matching str, or -1 if there's
+ * no such word, for every length up to the longest match.
+ * @return The length of the longest match
+ */
+int findMatches( WordList *wordList, char const *str, int len, int *codes );
+
+/**
+ * Writes a compiled image of the given wordList, which readWordList()
+ * can load without parsing, sorting or building anything.
+ *
+ * @param wordList A pointer to the wordlist
+ * @param fname The name of the image file
+ * @return false if the file couldn't be written
+ */
+bool writeWordImage( WordList *wordList, char const *fname );
+
 /**
  * Frees the WordList
  *
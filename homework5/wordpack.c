@@ -0,0 +1,545 @@
+/**
+ * @file wordpack.c
+ * @author Sam Whitlock (sjwhitlo)
+ *
+ * libwordpack, for compressing and uncompressing text in memory with a
+ * word list.  Codes are chosen the same way as pack, taking the longest
+ * word each time, so a compressor holds back the last few chars of each
+ * piece until it knows what comes after them.  A decompressor holds back
+ * the bytes of any partial group of codes.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+
+#include "wordpack.h"
+#include "wordlist.h"
+#include "bits.h"
+
+/** Number of codes encoded or decoded at a time. */
+#define CODE_BATCH 4096
+
+/** A loaded word list. */
+struct WpDict {
+  /** The word list. */
+  WordList *list;
+
+  /** Number of bits in each code. */
+  int codeBits;
+};
+
+/** State for compressing a stream a piece at a time. */
+struct WpCompressor {
+  /** The dictionary. */
+  const WpDict *dict;
+
+  /** Chars held back from the last piece, with room for a null
+      terminator. */
+  char pending[ WORD_MAX + 2 ];
+
+  /** Number of chars held back. */
+  size_t pendingLen;
+
+  /** Bits not yet stored, in the low-order positions. */
+  uint64_t acc;
+
+  /** Number of bits in acc. */
+  int bitCount;
+
+  /** True once the stream is finished. */
+  bool finished;
+};
+
+/** State for uncompressing a stream a piece at a time. */
+struct WpDecompressor {
+  /** The dictionary. */
+  const WpDict *dict;
+
+  /** Bytes of a group of codes that hasn't all arrived yet. */
+  unsigned char carry[ MAX_CODE_BITS ];
+
+  /** Number of bytes in carry. */
+  size_t carryLen;
+
+  /** True once the stream is finished. */
+  bool finished;
+};
+
+int wp_dict_load( const char *path, int codeBits, WpDict **dict )
+{
+    if (!path || !dict || codeBits < MIN_CODE_BITS || codeBits > MAX_CODE_BITS) {
+        return WP_ERR_ARGS;
+    }
+
+    WordListStatus status;
+    WordList *list = loadWordList(path, 1 << codeBits, &status);
+    if (!list) {
+        return status == WORD_FILE_MISSING ? WP_ERR_NO_FILE : WP_ERR_DICT;
+    }
+
+    *dict = (WpDict *)malloc(sizeof(WpDict));
+    if (!*dict) {
+        freeWordList(list);
+        return WP_ERR_MEMORY;
+    }
+    (*dict)->list = list;
+    (*dict)->codeBits = codeBits;
+    return WP_OK;
+}
+
+void wp_dict_free( WpDict *dict )
+{
+    if (dict) {
+        freeWordList(dict->list);
+        free(dict);
+    }
+}
+
+size_t wp_compress_bound( size_t len )
+{
+    // Up to WORD_MAX held back chars, plus the bits still in the register
+    return CODE_BYTES(len + WORD_MAX);
+}
+
+size_t wp_decompress_bound( const WpDict *dict, size_t len )
+{
+    // Up to a group of held back bytes, each code expanding to a word
+    size_t codes = (len + dict->codeBits) * BITS_PER_BYTE / dict->codeBits;
+    return codes * WORD_MAX;
+}
+
+/**
+ * Adds a code to a batch, writing the batch out once it's full.
+ *
+ * @param codes The batch
+ * @param n The number of codes in the batch, which is updated
+ * @param code The code
+ * @param writer The bit writer
+ */
+static void addCode( uint16_t *codes, int *n, int code, BitWriter *writer )
+{
+    codes[(*n)++] = code;
+    if (*n == CODE_BATCH) {
+        writeCodes(codes, *n, writer);
+        *n = 0;
+    }
+}
+
+/**
+ * Encodes the next piece of a stream.  The longest word at a position
+ * can only be found once there are more than WORD_MAX chars after it,
+ * or at the end of the stream, so any chars left short of that are held
+ * back.  Codes that start in chars held back last time are looked up in
+ * a copy with the start of this piece after them.
+ *
+ * @param compressor The compressor
+ * @param in The chars
+ * @param len The number of chars
+ * @param final True if this is the end of the stream
+ * @param writer The bit writer the codes go to
+ */
+static void encodeChars( WpCompressor *compressor, const char *in, size_t len,
+                         bool final, BitWriter *writer )
+{
+    WordList *list = compressor->dict->list;
+    uint16_t codes[CODE_BATCH];
+    int n = 0;
+    size_t pending = compressor->pendingLen;
+    size_t pos = 0;
+
+    if (pending > 0) {
+        char joined[2 * WORD_MAX + 2];
+        size_t take = len < WORD_MAX + 1 ? len : WORD_MAX + 1;
+        memcpy(joined, compressor->pending, pending);
+        memcpy(joined + pending, in, take);
+        joined[pending + take] = '\0';
+
+        size_t at = 0;
+        while (at < pending && (final || pending + len - at > WORD_MAX)) {
+            int code = bestCode(list, joined + at);
+            addCode(codes, &n, code, writer);
+            at += list->spans[code].length;
+        }
+
+        // Still not enough to go on, so hold back everything left
+        if (at < pending) {
+            memmove(compressor->pending, compressor->pending + at, pending - at);
+            memcpy(compressor->pending + pending - at, in, len);
+            compressor->pendingLen = pending - at + len;
+            writeCodes(codes, n, writer);
+            return;
+        }
+        pos = at - pending;
+    }
+
+    // The rest of the piece, straight from the input while there's enough
+    // after each position
+    while (pos + WORD_MAX < len) {
+        int code = bestCode(list, in + pos);
+        addCode(codes, &n, code, writer);
+        pos += list->spans[code].length;
+    }
+
+    // Hold back what's left, or encode it from a null-terminated copy at
+    // the end of the stream
+    compressor->pendingLen = len - pos;
+    memcpy(compressor->pending, in + pos, compressor->pendingLen);
+    if (final) {
+        compressor->pending[compressor->pendingLen] = '\0';
+        for (size_t at = 0; at < compressor->pendingLen; ) {
+            int code = bestCode(list, compressor->pending + at);
+            addCode(codes, &n, code, writer);
+            at += list->spans[code].length;
+        }
+        compressor->pendingLen = 0;
+    }
+    writeCodes(codes, n, writer);
+}
+
+/**
+ * Encodes a piece of a stream into a buffer with enough room for it.
+ *
+ * @param compressor The compressor
+ * @param in The chars
+ * @param len The number of chars
+ * @param final True if this is the end of the stream
+ * @param out Buffer with room for wp_compress_bound( len )
+ * @return The number of bytes stored in out
+ */
+static size_t compressPiece( WpCompressor *compressor, const char *in,
+                             size_t len, bool final, unsigned char *out )
+{
+    BitWriter writer;
+    initBitWriter(&writer, out, compressor->dict->codeBits);
+    writer.acc = compressor->acc;
+    writer.bitCount = compressor->bitCount;
+
+    encodeChars(compressor, in, len, final, &writer);
+    if (final) {
+        finishCodes(&writer);
+    }
+
+    compressor->acc = writer.acc;
+    compressor->bitCount = writer.bitCount;
+    return writer.len;
+}
+
+/**
+ * Sets up a compressor.
+ *
+ * @param compressor The compressor
+ * @param dict The dictionary
+ */
+static void initCompressor( WpCompressor *compressor, const WpDict *dict )
+{
+    compressor->dict = dict;
+    compressor->pendingLen = 0;
+    compressor->acc = 0;
+    compressor->bitCount = 0;
+    compressor->finished = false;
+}
+
+/**
+ * Checks that every char in a piece can be encoded.
+ *
+ * @param in The chars
+ * @param len The number of chars
+ * @return true if they're all valid
+ */
+static bool validChars( const char *in, size_t len )
+{
+    return findInvalidChar(in, len) == len;
+}
+
+int wp_compress( const WpDict *dict, const void *in, size_t len,
+                 void *out, size_t cap, size_t *written )
+{
+    if (!dict || (!in && len > 0) || !out || !written) {
+        return WP_ERR_ARGS;
+    }
+    *written = 0;
+    if (!validChars((const char *)in, len)) {
+        return WP_ERR_CHAR;
+    }
+
+    // Encode straight into the output if it's big enough for the worst
+    // case, and into a buffer that is otherwise
+    unsigned char *buf = (unsigned char *)out;
+    if (cap < wp_compress_bound(len)) {
+        buf = (unsigned char *)malloc(wp_compress_bound(len));
+        if (!buf) {
+            return WP_ERR_MEMORY;
+        }
+    }
+
+    WpCompressor compressor;
+    initCompressor(&compressor, dict);
+    size_t size = compressPiece(&compressor, (const char *)in, len, true, buf);
+
+    int status = WP_OK;
+    if (buf != out) {
+        if (size <= cap) {
+            memcpy(out, buf, size);
+        } else {
+            status = WP_ERR_SPACE;
+        }
+        free(buf);
+    }
+    if (status == WP_OK) {
+        *written = size;
+    }
+    return status;
+}
+
+int wp_compress_new( const WpDict *dict, WpCompressor **compressor )
+{
+    if (!dict || !compressor) {
+        return WP_ERR_ARGS;
+    }
+    *compressor = (WpCompressor *)malloc(sizeof(WpCompressor));
+    if (!*compressor) {
+        return WP_ERR_MEMORY;
+    }
+    initCompressor(*compressor, dict);
+    return WP_OK;
+}
+
+int wp_compress_update( WpCompressor *compressor, const void *in, size_t len,
+                        void *out, size_t cap, size_t *written )
+{
+    if (!compressor || (!in && len > 0) || !out || !written) {
+        return WP_ERR_ARGS;
+    }
+    *written = 0;
+    if (compressor->finished) {
+        return WP_ERR_STATE;
+    }
+    if (!validChars((const char *)in, len)) {
+        return WP_ERR_CHAR;
+    }
+    if (cap < wp_compress_bound(len)) {
+        return WP_ERR_SPACE;
+    }
+
+    *written = compressPiece(compressor, (const char *)in, len, false,
+                             (unsigned char *)out);
+    return WP_OK;
+}
+
+int wp_compress_finish( WpCompressor *compressor, void *out, size_t cap,
+                        size_t *written )
+{
+    if (!compressor || !out || !written) {
+        return WP_ERR_ARGS;
+    }
+    *written = 0;
+    if (compressor->finished) {
+        return WP_ERR_STATE;
+    }
+    if (cap < wp_compress_bound(0)) {
+        return WP_ERR_SPACE;
+    }
+
+    *written = compressPiece(compressor, "", 0, true, (unsigned char *)out);
+    compressor->finished = true;
+    return WP_OK;
+}
+
+void wp_compress_free( WpCompressor *compressor )
+{
+    free(compressor);
+}
+
+/**
+ * Expands a batch of codes after the chars already in the output.
+ *
+ * @param dict The dictionary
+ * @param codes The codes
+ * @param n The number of codes
+ * @param out Buffer for the chars
+ * @param total The number of chars already in out, which is updated
+ * @param cap The size of out
+ * @return WP_OK, or an error code
+ */
+static int expandBatch( const WpDict *dict, const uint16_t *codes, size_t n,
+                        char *out, size_t *total, size_t cap )
+{
+    for (size_t i = 0; i < n; i++) {
+        if (codes[i] >= dict->list->len) {
+            return WP_ERR_DATA;
+        }
+    }
+    return copyWords(dict->list, codes, n, out, total, cap) ? WP_OK
+                                                            : WP_ERR_SPACE;
+}
+
+/**
+ * Decodes the next piece of a stream.  Whole groups of codes are decoded
+ * straight from the input, after completing the group held back last
+ * time, and the bytes of any partial group at the end are held back.
+ * At the end of the stream, the codes in the last, partial group are
+ * decoded too.
+ *
+ * @param decompressor The decompressor
+ * @param in The bytes
+ * @param len The number of bytes
+ * @param final True if this is the end of the stream
+ * @param out Buffer for the chars
+ * @param cap The size of out
+ * @param written Set to the number of chars stored in out
+ * @return WP_OK, or an error code.  On an error, the decompressor is
+ * left as it was.
+ */
+static int decompressPiece( WpDecompressor *decompressor,
+                            const unsigned char *in, size_t len, bool final,
+                            char *out, size_t cap, size_t *written )
+{
+    const WpDict *dict = decompressor->dict;
+    int codeBits = dict->codeBits;
+    uint16_t codes[CODE_BATCH];
+    size_t total = 0;
+    int status = WP_OK;
+
+    // Finish the held back group first
+    unsigned char carry[MAX_CODE_BITS];
+    size_t carryLen = decompressor->carryLen;
+    memcpy(carry, decompressor->carry, carryLen);
+    size_t take = codeBits - carryLen < len ? codeBits - carryLen : len;
+    memcpy(carry + carryLen, in, take);
+    carryLen += take;
+    size_t pos = take;
+    if (carryLen == codeBits || (final && carryLen > 0)) {
+        size_t n = readCodes(carry, carryLen, codeBits, codes);
+        status = expandBatch(dict, codes, n, out, &total, cap);
+        carryLen = 0;
+    }
+
+    // Then whole groups, and at the end, the partial group after them
+    size_t end = pos + (len - pos) / codeBits * codeBits;
+    if (final) {
+        end = len;
+    }
+    size_t step = CODE_BATCH / GROUP_CODES * codeBits;
+    while (status == WP_OK && pos < end) {
+        size_t chunk = end - pos < step ? end - pos : step;
+        size_t n = readCodes(in + pos, chunk, codeBits, codes);
+        status = expandBatch(dict, codes, n, out, &total, cap);
+        pos += chunk;
+    }
+    if (status != WP_OK) {
+        return status;
+    }
+
+    if (pos < len) {
+        carryLen = len - pos;
+        memcpy(carry, in + pos, carryLen);
+    }
+    memcpy(decompressor->carry, carry, carryLen);
+    decompressor->carryLen = carryLen;
+    *written = total;
+    return WP_OK;
+}
+
+/**
+ * Sets up a decompressor.
+ *
+ * @param decompressor The decompressor
+ * @param dict The dictionary
+ */
+static void initDecompressor( WpDecompressor *decompressor, const WpDict *dict )
+{
+    decompressor->dict = dict;
+    decompressor->carryLen = 0;
+    decompressor->finished = false;
+}
+
+int wp_decompress( const WpDict *dict, const void *in, size_t len,
+                   void *out, size_t cap, size_t *written )
+{
+    if (!dict || (!in && len > 0) || !out || !written) {
+        return WP_ERR_ARGS;
+    }
+    *written = 0;
+
+    WpDecompressor decompressor;
+    initDecompressor(&decompressor, dict);
+    return decompressPiece(&decompressor, (const unsigned char *)in, len,
+                           true, (char *)out, cap, written);
+}
+
+int wp_decompress_new( const WpDict *dict, WpDecompressor **decompressor )
+{
+    if (!dict || !decompressor) {
+        return WP_ERR_ARGS;
+    }
+    *decompressor = (WpDecompressor *)malloc(sizeof(WpDecompressor));
+    if (!*decompressor) {
+        return WP_ERR_MEMORY;
+    }
+    initDecompressor(*decompressor, dict);
+    return WP_OK;
+}
+
+int wp_decompress_update( WpDecompressor *decompressor, const void *in,
+                          size_t len, void *out, size_t cap, size_t *written )
+{
+    if (!decompressor || (!in && len > 0) || !out || !written) {
+        return WP_ERR_ARGS;
+    }
+    *written = 0;
+    if (decompressor->finished) {
+        return WP_ERR_STATE;
+    }
+    return decompressPiece(decompressor, (const unsigned char *)in, len,
+                           false, (char *)out, cap, written);
+}
+
+int wp_decompress_finish( WpDecompressor *decompressor, void *out, size_t cap,
+                          size_t *written )
+{
+    if (!decompressor || !out || !written) {
+        return WP_ERR_ARGS;
+    }
+    *written = 0;
+    if (decompressor->finished) {
+        return WP_ERR_STATE;
+    }
+    int status = decompressPiece(decompressor, (const unsigned char *)"", 0,
+                                 true, (char *)out, cap, written);
+    if (status == WP_OK) {
+        decompressor->finished = true;
+    }
+    return status;
+}
+
+void wp_decompress_free( WpDecompressor *decompressor )
+{
+    free(decompressor);
+}
+
+const char *wp_error_string( int code )
+{
+    switch (code) {
+    case WP_OK:
+        return "Success";
+    case WP_ERR_ARGS:
+        return "Invalid argument";
+    case WP_ERR_NO_FILE:
+        return "Can't open word file";
+    case WP_ERR_DICT:
+        return "Invalid word file";
+    case WP_ERR_MEMORY:
+        return "Out of memory";
+    case WP_ERR_CHAR:
+        return "Invalid character code";
+    case WP_ERR_SPACE:
+        return "Output buffer too small";
+    case WP_ERR_DATA:
+        return "Invalid compressed data";
+    case WP_ERR_STATE:
+        return "Stream already finished";
+    default:
+        return "Unknown error";
+    }
+}
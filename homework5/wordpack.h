@@ -0,0 +1,223 @@
+/**
+ * @file wordpack.h
+ * @author Sam Whitlock (sjwhitlo)
+ *
+ * Interface of libwordpack, for compressing and uncompressing text in
+ * memory with a word list.  The compressed form is the one pack writes
+ * by default: each word's code in turn, low-order bit first, with the
+ * last byte padded with zeros.  With a dictionary loaded for 9-bit codes,
+ * wp_compress() gives the same bytes as pack, and unpack can read them.
+ *
+ * Nothing here exits or prints.  Every function that can fail returns
+ * WP_OK or one of the negative WP_ERR codes.  A dictionary is read-only
+ * once it's loaded, so any number of threads can use it at once, each
+ * with its own compressor or decompressor.
+ */
+
+#ifndef _WORDPACK_H_
+#define _WORDPACK_H_
+
+#include <stddef.h>
+
+/** Success. */
+#define WP_OK 0
+
+/** A required pointer was NULL, or a number was out of range. */
+#define WP_ERR_ARGS -1
+
+/** The word file couldn't be opened. */
+#define WP_ERR_NO_FILE -2
+
+/** The word file isn't valid, or has too many words for the codes. */
+#define WP_ERR_DICT -3
+
+/** Out of memory. */
+#define WP_ERR_MEMORY -4
+
+/** The text to compress has a char that can't be encoded. */
+#define WP_ERR_CHAR -5
+
+/** The output buffer is too small. */
+#define WP_ERR_SPACE -6
+
+/** The compressed data has a code that isn't in the dictionary. */
+#define WP_ERR_DATA -7
+
+/** The stream has already been finished. */
+#define WP_ERR_STATE -8
+
+/** A loaded word list. */
+typedef struct WpDict WpDict;
+
+/** State for compressing a stream a piece at a time. */
+typedef struct WpCompressor WpCompressor;
+
+/** State for uncompressing a stream a piece at a time. */
+typedef struct WpDecompressor WpDecompressor;
+
+/**
+ * Loads a word file, or an image made by wordlist compile.
+ *
+ * @param path The name of the file
+ * @param codeBits Number of bits in each code, from 9 to 16
+ * @param dict Set to the dictionary
+ * @return WP_OK, or an error code
+ */
+int wp_dict_load( const char *path, int codeBits, WpDict **dict );
+
+/**
+ * Frees a dictionary.  No compressor or decompressor can still be
+ * using it.
+ *
+ * @param dict The dictionary, or NULL
+ */
+void wp_dict_free( WpDict *dict );
+
+/**
+ * Returns the most bytes compressing len chars can produce, which is
+ * the room wp_compress_update() needs.  wp_compress_finish() needs
+ * wp_compress_bound( 0 ).
+ *
+ * @param len The number of chars
+ * @return The most bytes of output
+ */
+size_t wp_compress_bound( size_t len );
+
+/**
+ * Returns the most chars uncompressing len bytes can produce, counting
+ * bytes held back from earlier pieces of a stream.
+ *
+ * @param dict The dictionary
+ * @param len The number of bytes
+ * @return The most chars of output
+ */
+size_t wp_decompress_bound( const WpDict *dict, size_t len );
+
+/**
+ * Compresses a buffer.
+ *
+ * @param dict The dictionary
+ * @param in The chars to compress
+ * @param len The number of chars
+ * @param out Buffer for the compressed bytes
+ * @param cap The size of out
+ * @param written Set to the number of bytes stored in out
+ * @return WP_OK, or an error code
+ */
+int wp_compress( const WpDict *dict, const void *in, size_t len,
+                 void *out, size_t cap, size_t *written );
+
+/**
+ * Uncompresses a buffer.
+ *
+ * @param dict The dictionary it was compressed with
+ * @param in The compressed bytes
+ * @param len The number of bytes
+ * @param out Buffer for the chars
+ * @param cap The size of out
+ * @param written Set to the number of chars stored in out
+ * @return WP_OK, or an error code
+ */
+int wp_decompress( const WpDict *dict, const void *in, size_t len,
+                   void *out, size_t cap, size_t *written );
+
+/**
+ * Starts compressing a stream.
+ *
+ * @param dict The dictionary, which has to outlast the compressor
+ * @param compressor Set to the new compressor
+ * @return WP_OK, or an error code
+ */
+int wp_compress_new( const WpDict *dict, WpCompressor **compressor );
+
+/**
+ * Compresses the next piece of a stream.  Chars near the end of the
+ * piece may be held back until the next call, since the word they start
+ * depends on what follows.  If this fails, nothing is used up, so the
+ * call can be tried again.
+ *
+ * @param compressor The compressor
+ * @param in The chars to compress
+ * @param len The number of chars
+ * @param out Buffer for the compressed bytes, with room for
+ * wp_compress_bound( len )
+ * @param cap The size of out
+ * @param written Set to the number of bytes stored in out
+ * @return WP_OK, or an error code
+ */
+int wp_compress_update( WpCompressor *compressor, const void *in, size_t len,
+                        void *out, size_t cap, size_t *written );
+
+/**
+ * Compresses the rest of a stream.
+ *
+ * @param compressor The compressor
+ * @param out Buffer for the compressed bytes, with room for
+ * wp_compress_bound( 0 )
+ * @param cap The size of out
+ * @param written Set to the number of bytes stored in out
+ * @return WP_OK, or an error code
+ */
+int wp_compress_finish( WpCompressor *compressor, void *out, size_t cap,
+                        size_t *written );
+
+/**
+ * Frees a compressor.
+ *
+ * @param compressor The compressor, or NULL
+ */
+void wp_compress_free( WpCompressor *compressor );
+
+/**
+ * Starts uncompressing a stream.
+ *
+ * @param dict The dictionary, which has to outlast the decompressor
+ * @param decompressor Set to the new decompressor
+ * @return WP_OK, or an error code
+ */
+int wp_decompress_new( const WpDict *dict, WpDecompressor **decompressor );
+
+/**
+ * Uncompresses the next piece of a stream.  If this fails, nothing is
+ * used up, so the call can be tried again, with more room for output
+ * or a smaller piece.
+ *
+ * @param decompressor The decompressor
+ * @param in The compressed bytes
+ * @param len The number of bytes
+ * @param out Buffer for the chars
+ * @param cap The size of out
+ * @param written Set to the number of chars stored in out
+ * @return WP_OK, or an error code
+ */
+int wp_decompress_update( WpDecompressor *decompressor, const void *in,
+                          size_t len, void *out, size_t cap, size_t *written );
+
+/**
+ * Uncompresses the rest of a stream.
+ *
+ * @param decompressor The decompressor
+ * @param out Buffer for the chars
+ * @param cap The size of out
+ * @param written Set to the number of chars stored in out
+ * @return WP_OK, or an error code
+ */
+int wp_decompress_finish( WpDecompressor *decompressor, void *out, size_t cap,
+                          size_t *written );
+
+/**
+ * Frees a decompressor.
+ *
+ * @param decompressor The decompressor, or NULL
+ */
+void wp_decompress_free( WpDecompressor *decompressor );
+
+/**
+ * Returns a description of an error code.
+ *
+ * @param code The code
+ * @return The description
+ */
+const char *wp_error_string( int code );
+
+#endif
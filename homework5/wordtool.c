@@ -0,0 +1,60 @@
+/**
+ * @file wordtool.c
+ * @author Sam Whitlock (sjwhitlo)
+ *
+ * Tool for preparing word lists.  The compile command reads a word file
+ * and writes a compiled image of it, already sorted and with the index
+ * used to find matches built, which pack and unpack can map into memory
+ * and use directly instead of the text file.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+
+#include "wordlist.h"
+#include "bits.h"
+
+/** Usage message. */
+#define USAGE "usage: wordlist compile <word_file.txt> <words.bin>"
+/** Can't write the image. */
+#define FILE_ERROR "Can't open file: %s\n"
+/** Command for compiling a word list. */
+#define COMPILE_CMD "compile"
+/** Expected number of command line arguments. */
+#define CMD_ARGS 4
+
+/**
+ * Prints the usage message and exits.
+ */
+static void usage()
+{
+    fprintf(stderr, "%s\n", USAGE);
+    exit(EXIT_FAILURE);
+}
+
+/**
+ * Program starting point.  Compiles the given word file into an image.
+ *
+ * @param argc Number of command-line arguments
+ * @param argv List of command-line arguments
+ * @return The program's exit status
+ */
+int main( int argc, char *argv[] )
+{
+    if (argc != CMD_ARGS || strcmp(argv[1], COMPILE_CMD) != 0) {
+        usage();
+    }
+    
+    // The image has room for every code, so it works at any width
+    WordList *wordList = readWordList(argv[2], 1 << MAX_CODE_BITS);
+    bool ok = writeWordImage(wordList, argv[3]);
+    freeWordList(wordList);
+    
+    if (!ok) {
+        fprintf(stderr, FILE_ERROR, argv[3]);
+        return EXIT_FAILURE;
+    }
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,745 @@
+/**
+ * @file wordtrain.c
+ * @author Sam Whitlock (sjwhitlo)
+ *
+ * Builds a word file for a particular kind of input.  Takes a sample
+ * corpus and the name of the word file to write, and picks the strings
+ * that save the most codes when the corpus is packed.
+ *
+ * Every string of 2 to WORD_MAX valid chars in the sample is counted
+ * exactly, by sorting the positions of the sample by the string starting
+ * at each, and the repeated ones go in a hash table.  The ones that occur
+ * most, weighted by the codes each use would save, become the
+ * candidates.  Since a word only helps if the parse actually picks it,
+ * the list is then refined over a few rounds: the sample is parsed with
+ * the current list, words that were used the least are dropped and the
+ * next best candidates take their place, and the list that packed the
+ * sample in the fewest codes is written out.
+ *
+ * Large corpora are sampled, taking evenly spaced chunks up to --sample
+ * bytes, so training time doesn't grow with the size of the corpus.
+ * --width sets the number of bits in each code, which decides how many
+ * words there's room for, and --optimal trains for pack --optimal.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "wordlist.h"
+#include "bits.h"
+#include "codec.h"
+
+/** Usage message. */
+#define USAGE "usage: wordtrain [--width N] [--optimal] [--sample N] <corpus.txt> <word_file.txt>"
+/** Can't open file. */
+#define FILE_ERROR "Can't open file: %s\n"
+/** Expected number of command line arguments. */
+#define CMD_ARGS 3
+/** Option for the number of bits per code, followed by the number. */
+#define WIDTH_OPT "--width"
+/** Option for training for parseOptimal(). */
+#define OPTIMAL_OPT "--optimal"
+/** Option for the most bytes of the corpus to look at, followed by the
+    number. */
+#define SAMPLE_OPT "--sample"
+/** File name standing for standard input. */
+#define STD_STREAM "-"
+/** Default number of bytes of the corpus to look at. */
+#define DEFAULT_SAMPLE (8 << 20)
+/** Size of each chunk taken from a corpus larger than the sample. */
+#define SAMPLE_CHUNK (1 << 16)
+/** Number of buckets the positions of the sample are first sorted into,
+    one for each pair of chars they start with. */
+#define BUCKETS (1 << 16)
+/** Bucket for the positions starting with the first 2 chars of s. */
+#define BUCKET(s) ((unsigned char)(s)[0] << 8 | (unsigned char)(s)[1])
+/** Number of slots in the table of counted strings. */
+#define TABLE_SIZE (1 << 22)
+/** Number of candidates kept for each code there's room for. */
+#define CANDIDATES_PER_CODE 4
+/** Number of times the list is parsed and refined. */
+#define TRAIN_ROUNDS 8
+/** Each round, the least used 1 / REFILL_SHARE of the words are replaced. */
+#define REFILL_SHARE 8
+/** Initial value of the string hash (FNV-1a). */
+#define HASH_SEED 2166136261u
+/** Multiplier of the string hash (FNV-1a). */
+#define HASH_PRIME 16777619u
+
+/** A string counted in the sample. */
+typedef struct {
+  /** Where one occurrence of the string is in the sample. */
+  uint32_t offset;
+
+  /** Number of times it occurs, or 0 for an empty slot. */
+  uint32_t count;
+
+  /** Hash of the string. */
+  uint32_t hash;
+
+  /** Length of the string. */
+  uint32_t len;
+} Gram;
+
+/** Open-addressed hash table of the strings in the sample. */
+typedef struct {
+  /** The sample the strings are in. */
+  const char *sample;
+
+  /** TABLE_SIZE slots. */
+  Gram *slots;
+
+  /** Number of slots in use. */
+  int used;
+
+  /** Strings counted this many times or fewer have been dropped to make
+      room for others. */
+  uint32_t floor;
+} GramTable;
+
+/** A word on the list being trained, and the codes it saved. */
+typedef struct {
+  /** The word. */
+  Word word;
+
+  /** Length of the word. */
+  int len;
+
+  /** Codes saved by the word in the last parse, or its estimated
+      saving if it hasn't been parsed with yet. */
+  uint64_t saving;
+} Candidate;
+
+/**
+ * Prints an error message passed in as a paramater.
+ *
+ * @param message a pointer to the message to be printed.
+ */
+void error(char *message)
+{
+    fprintf(stderr, "%s\n", message);
+    exit(EXIT_FAILURE);
+}
+
+/**
+ * Reads the sample to train on.  If the corpus is no larger than limit,
+ * it's read whole, otherwise evenly spaced chunks of it are.  Chunks are
+ * separated by a null char, which isn't valid, so no string is counted
+ * across the gap between them.
+ *
+ * @param fname The name of the corpus, or "-" for standard input
+ * @param limit The most bytes to read
+ * @param len Set to the number of bytes in the sample
+ * @return The sample
+ */
+char *readSample(char *fname, size_t limit, size_t *len)
+{
+    FILE *fp = strcmp(fname, STD_STREAM) == 0 ? stdin : fopen(fname, "rb");
+    if (!fp) {
+        fprintf(stderr, FILE_ERROR, fname);
+        exit(EXIT_FAILURE);
+    }
+
+    // Standard input or a small file is just read from the start
+    long size = -1;
+    if (fp != stdin && fseek(fp, 0, SEEK_END) == 0) {
+        size = ftell(fp);
+    }
+    size_t chunks = limit / SAMPLE_CHUNK;
+    if (size < 0 || size <= limit || chunks < 2) {
+        rewind(fp);
+        char *sample = (char *)malloc(limit + 1);
+        *len = fread(sample, 1, limit, fp);
+        if (fp != stdin) {
+            fclose(fp);
+        }
+        return sample;
+    }
+
+    char *sample = (char *)malloc(chunks * (SAMPLE_CHUNK + 1));
+    long stride = size / chunks;
+    *len = 0;
+    for (size_t i = 0; i < chunks; i++) {
+        fseek(fp, i * stride, SEEK_SET);
+        *len += fread(sample + *len, 1, SAMPLE_CHUNK, fp);
+        sample[(*len)++] = '\0';
+    }
+    fclose(fp);
+
+    return sample;
+}
+
+/**
+ * Puts a string in the first free slot for its hash.
+ *
+ * @param slots The slots of the table
+ * @param gram The string
+ */
+void placeGram(Gram *slots, Gram gram)
+{
+    uint32_t slot = gram.hash & (TABLE_SIZE - 1);
+    while (slots[slot].count) {
+        slot = (slot + 1) & (TABLE_SIZE - 1);
+    }
+    slots[slot] = gram;
+}
+
+/**
+ * Makes room in a table that's getting full, by dropping the strings
+ * counted the fewest times.  This only loses strings that are rare
+ * compared to the ones being kept.
+ *
+ * @param table The table
+ */
+void pruneGrams(GramTable *table)
+{
+    Gram *old = table->slots;
+    table->slots = (Gram *)calloc(TABLE_SIZE, sizeof(Gram));
+    while (table->used > TABLE_SIZE / 2) {
+        table->floor++;
+        table->used = 0;
+        memset(table->slots, 0, TABLE_SIZE * sizeof(Gram));
+        for (int i = 0; i < TABLE_SIZE; i++) {
+            if (old[i].count > table->floor) {
+                placeGram(table->slots, old[i]);
+                table->used++;
+            }
+        }
+    }
+    free(old);
+}
+
+/**
+ * Adds a string to the table, with the number of times it occurs.  It's
+ * left out if strings that occur that few times have already been
+ * dropped to make room.
+ *
+ * @param table The table
+ * @param offset Where the string is in the sample
+ * @param len Length of the string
+ * @param count The number of times it occurs
+ */
+void addGram(GramTable *table, uint32_t offset, int len, uint32_t count)
+{
+    if (count <= table->floor) {
+        return;
+    }
+    uint32_t hash = HASH_SEED;
+    for (int i = 0; i < len; i++) {
+        hash = (hash ^ (unsigned char)table->sample[offset + i]) * HASH_PRIME;
+    }
+    Gram gram = { offset, count, hash, len };
+    placeGram(table->slots, gram);
+    if (++table->used > TABLE_SIZE / 4 * 3) {
+        pruneGrams(table);
+    }
+}
+
+/** Text whose positions are being sorted by comparePositions(). */
+static const char *sortText;
+
+/**
+ * Compares the strings at two positions of sortText, past the two chars
+ * they're already known to share.  Strings end at a null char, and only
+ * the first WORD_MAX chars count.
+ *
+ * @param a A pointer to the first position
+ * @param b A pointer to the second position
+ * @return neg if a's string comes first, 0 if equal, else pos
+ */
+static int comparePositions(const void *a, const void *b)
+{
+    return strncmp(sortText + *(const uint32_t *)a + 2,
+                   sortText + *(const uint32_t *)b + 2, WORD_MAX - 2);
+}
+
+/**
+ * Returns the number of chars two strings share at their start, up to
+ * WORD_MAX.  Strings end at a null char.
+ *
+ * @param a The first string
+ * @param b The second string
+ * @return The length of the common prefix
+ */
+static int commonPrefix(const char *a, const char *b)
+{
+    int n = 0;
+    while (n < WORD_MAX && a[n] && a[n] == b[n]) {
+        n++;
+    }
+    return n;
+}
+
+/**
+ * Counts the strings of 2 to WORD_MAX valid chars in the sample, and
+ * adds the ones that occur more than once to the table.  The positions
+ * of the sample are sorted by the string starting at each, so every
+ * occurrence of a string ends up in one run of positions, and the count
+ * for each length is just the length of the run of positions sharing
+ * that many chars.  The counts are exact, however long the string.
+ *
+ * @param table The table to count in
+ * @param sample The sample
+ * @param len The length of the sample
+ */
+void countGrams(GramTable *table, const char *sample, size_t len)
+{
+    // A copy of the sample with nulls in place of invalid chars and
+    // after the end, so a string stops at the first char it can't have
+    char *text = (char *)calloc(len + WORD_MAX, 1);
+    for (size_t i = 0; i < len; i++) {
+        text[i] = validChar(sample[i]) ? sample[i] : '\0';
+    }
+
+    // Sort the positions starting at least 2 valid chars into buckets by
+    // those chars, then sort each bucket by the rest
+    uint32_t *start = (uint32_t *)calloc(BUCKETS + 1, sizeof(uint32_t));
+    for (size_t i = 0; i + 1 < len; i++) {
+        if (text[i] && text[i + 1]) {
+            start[BUCKET(text + i) + 1]++;
+        }
+    }
+    for (int b = 0; b < BUCKETS; b++) {
+        start[b + 1] += start[b];
+    }
+    uint32_t m = start[BUCKETS];
+    uint32_t *pos = (uint32_t *)malloc((m + 1) * sizeof(uint32_t));
+    uint32_t *next = (uint32_t *)malloc(BUCKETS * sizeof(uint32_t));
+    memcpy(next, start, BUCKETS * sizeof(uint32_t));
+    for (size_t i = 0; i + 1 < len; i++) {
+        if (text[i] && text[i + 1]) {
+            pos[next[BUCKET(text + i)]++] = i;
+        }
+    }
+    sortText = text;
+    for (int b = 0; b < BUCKETS; b++) {
+        qsort(pos + start[b], start[b + 1] - start[b], sizeof(uint32_t),
+              comparePositions);
+    }
+
+    // For each length, a run of positions ends where the next position
+    // shares fewer chars with the last one.  A run of at least 2 is a
+    // repeated string.
+    uint32_t runStart[WORD_MAX + 1] = { 0 };
+    for (uint32_t k = 1; k <= m; k++) {
+        int common = 0;
+        if (k < m) {
+            common = commonPrefix(text + pos[k - 1], text + pos[k]);
+        }
+        for (int n = common < 2 ? 2 : common + 1; n <= WORD_MAX; n++) {
+            if (k - runStart[n] >= 2) {
+                addGram(table, pos[k - 1], n, k - runStart[n]);
+            }
+            runStart[n] = k;
+        }
+    }
+
+    free(next);
+    free(pos);
+    free(start);
+    free(text);
+}
+
+/**
+ * Finds a string in the table.
+ *
+ * @param table The table
+ * @param str The string, which is somewhere in the sample
+ * @param len Length of the string
+ * @return The string's slot, or NULL if it isn't in the table
+ */
+Gram *findGram(GramTable *table, const char *str, int len)
+{
+    uint32_t hash = HASH_SEED;
+    for (int i = 0; i < len; i++) {
+        hash = (hash ^ (unsigned char)str[i]) * HASH_PRIME;
+    }
+
+    uint32_t slot = hash & (TABLE_SIZE - 1);
+    while (table->slots[slot].count) {
+        Gram *gram = table->slots + slot;
+        if (gram->hash == hash && gram->len == len
+            && memcmp(table->sample + gram->offset, str, len) == 0) {
+            return gram;
+        }
+        slot = (slot + 1) & (TABLE_SIZE - 1);
+    }
+    return NULL;
+}
+
+/**
+ * Returns the number of codes a string would save if every remaining
+ * occurrence of it were packed as one code.
+ *
+ * @param gram The string
+ * @return The codes it would save
+ */
+uint64_t gramSaving(const Gram *gram)
+{
+    return gram->count > 1 ? (uint64_t)gram->count * (gram->len - 1) : 0;
+}
+
+/**
+ * Moves the entry at i up the heap of strings until its parent saves
+ * at least as much.
+ *
+ * @param heap The heap, as pointers to strings in the table
+ * @param savings The saving each entry was added to the heap with
+ * @param i The entry to move
+ */
+void siftUp(Gram **heap, uint64_t *savings, int i)
+{
+    while (i > 0 && savings[(i - 1) / 2] < savings[i]) {
+        int parent = (i - 1) / 2;
+        Gram *gram = heap[i];
+        heap[i] = heap[parent];
+        heap[parent] = gram;
+        uint64_t saving = savings[i];
+        savings[i] = savings[parent];
+        savings[parent] = saving;
+        i = parent;
+    }
+}
+
+/**
+ * Moves the entry at i down the heap of strings until both its
+ * children save no more than it does.
+ *
+ * @param heap The heap, as pointers to strings in the table
+ * @param savings The saving each entry was added to the heap with
+ * @param n The number of entries in the heap
+ * @param i The entry to move
+ */
+void siftDown(Gram **heap, uint64_t *savings, int n, int i)
+{
+    while (2 * i + 1 < n) {
+        int child = 2 * i + 1;
+        if (child + 1 < n && savings[child + 1] > savings[child]) {
+            child++;
+        }
+        if (savings[child] <= savings[i]) {
+            break;
+        }
+        Gram *gram = heap[i];
+        heap[i] = heap[child];
+        heap[child] = gram;
+        uint64_t saving = savings[i];
+        savings[i] = savings[child];
+        savings[child] = saving;
+        i = child;
+    }
+}
+
+/**
+ * Makes the list of candidates, best first.  The string that would save
+ * the most is taken each time, and then, since the chars it covers can't
+ * also be packed by a shorter word inside it, its occurrences are taken
+ * off the count of each string it contains.  Strings whose saving went
+ * down since they were put on the heap go back on with their new saving.
+ *
+ * @param table The table of counted strings
+ * @param limit The most candidates to make
+ * @param count Set to the number of candidates
+ * @return The candidates, best first
+ */
+Candidate *makeCandidates(GramTable *table, int limit, int *count)
+{
+    Gram **heap = (Gram **)malloc(table->used * sizeof(Gram *));
+    uint64_t *savings = (uint64_t *)malloc(table->used * sizeof(uint64_t));
+    int n = 0;
+    for (int i = 0; i < TABLE_SIZE; i++) {
+        if (gramSaving(table->slots + i) > 0) {
+            heap[n] = table->slots + i;
+            savings[n] = gramSaving(table->slots + i);
+            siftUp(heap, savings, n++);
+        }
+    }
+
+    Candidate *list = (Candidate *)malloc(limit * sizeof(Candidate));
+    *count = 0;
+    while (n > 0 && *count < limit) {
+        Gram *gram = heap[0];
+        uint64_t saving = gramSaving(gram);
+        if (saving < savings[0]) {
+            // Its count went down, so see where it fits now
+            savings[0] = saving;
+            if (saving == 0) {
+                heap[0] = heap[--n];
+                savings[0] = savings[n];
+            }
+            siftDown(heap, savings, n, 0);
+            continue;
+        }
+        heap[0] = heap[--n];
+        savings[0] = savings[n];
+        siftDown(heap, savings, n, 0);
+
+        const char *str = table->sample + gram->offset;
+        Candidate *candidate = list + (*count)++;
+        memcpy(candidate->word, str, gram->len);
+        candidate->word[gram->len] = '\0';
+        candidate->len = gram->len;
+        candidate->saving = saving;
+
+        // The strings inside this one lose the occurrences it covers
+        uint32_t covered = gram->count;
+        gram->count = 0;
+        for (int start = 0; start < candidate->len - 1; start++) {
+            for (int len = 2; start + len <= candidate->len; len++) {
+                Gram *inner = findGram(table, str + start, len);
+                if (inner) {
+                    inner->count -= inner->count < covered ? inner->count
+                                                           : covered;
+                }
+            }
+        }
+    }
+
+    free(heap);
+    free(savings);
+    return list;
+}
+
+/**
+ * Compares candidates, so the ones that save the most come first, and
+ * then the longer ones, then in order of their chars.
+ *
+ * @param a A pointer to the first candidate
+ * @param b A pointer to the second candidate
+ * @return neg if a comes first, 0 if equal, else pos
+ */
+int compareCandidates(const void *a, const void *b)
+{
+    const Candidate *ca = (const Candidate *)a;
+    const Candidate *cb = (const Candidate *)b;
+    if (ca->saving != cb->saving) {
+        return ca->saving > cb->saving ? -1 : 1;
+    }
+    if (ca->len != cb->len) {
+        return cb->len - ca->len;
+    }
+    return strcmp(ca->word, cb->word);
+}
+
+/**
+ * Parses the sample with the given word list the way pack would, and
+ * counts the number of times each code is used.  Each run of valid chars
+ * is parsed separately.
+ *
+ * @param wordList The word list
+ * @param sample The sample
+ * @param len The length of the sample
+ * @param optimal True to parse with parseOptimal() instead of greedily
+ * @param uses Set to the number of uses of each code
+ */
+void countUses(WordList *wordList, const char *sample, size_t len,
+               bool optimal, uint64_t *uses)
+{
+    uint16_t *codes = optimal ? (uint16_t *)malloc(len * sizeof(uint16_t))
+                              : NULL;
+    int matches[WORD_MAX];
+
+    size_t i = 0;
+    while (i < len) {
+        if (!validChar(sample[i])) {
+            i++;
+            continue;
+        }
+        size_t end = i;
+        while (end < len && validChar(sample[end])) {
+            end++;
+        }
+
+        if (optimal) {
+            size_t n = parseOptimal(wordList, sample + i, end - i, codes);
+            for (size_t k = 0; k < n; k++) {
+                uses[codes[k]]++;
+            }
+        } else {
+            for (size_t pos = i; pos < end; ) {
+                int longest = findMatches(wordList, sample + pos, end - pos
+                                          < WORD_MAX ? end - pos : WORD_MAX,
+                                          matches);
+                uses[matches[longest - 1]]++;
+                pos += longest;
+            }
+        }
+        i = end;
+    }
+
+    free(codes);
+}
+
+/**
+ * Chooses the words to use, starting from the best candidates and
+ * refining them by parsing the sample with them.  After each parse,
+ * words that were never picked, and the least used of the rest, are
+ * replaced by the next candidates.  A change doesn't always help, since
+ * a greedy parse can be led astray by a new word, so the list that gave
+ * the fewest codes is the one kept, and the next round starts from it.
+ *
+ * @param candidates The candidates, best first
+ * @param candidateCount The number of candidates
+ * @param sample The sample
+ * @param len The length of the sample
+ * @param maxCodes The number of codes available
+ * @param optimal True to parse with parseOptimal() instead of greedily
+ * @param best Set to the chosen words, most useful first.  There's
+ * room for maxCodes of them.
+ * @return The number of chosen words
+ */
+int chooseWords(Candidate *candidates, int candidateCount, const char *sample,
+                size_t len, int maxCodes, bool optimal, Candidate *best)
+{
+    WordList *chars = makeWordList();
+    int room = maxCodes - chars->len;
+    freeWordList(chars);
+
+    Candidate *chosen = (Candidate *)malloc(maxCodes * sizeof(Candidate));
+    int count = candidateCount < room ? candidateCount : room;
+    memcpy(chosen, candidates, count * sizeof(Candidate));
+    int next = count;
+    int bestCount = 0;
+    uint64_t bestCodes = UINT64_MAX;
+
+    uint64_t *uses = (uint64_t *)malloc(maxCodes * sizeof(uint64_t));
+    for (int round = 0; round < TRAIN_ROUNDS; round++) {
+        WordList *wordList = makeWordList();
+        for (int i = 0; i < count; i++) {
+            addWord(wordList, chosen[i].word, chosen[i].len);
+        }
+        indexWordList(wordList, maxCodes);
+
+        memset(uses, 0, maxCodes * sizeof(uint64_t));
+        countUses(wordList, sample, len, optimal, uses);
+
+        // Keep the words that were used, with what they actually saved
+        uint64_t codes = 0;
+        count = 0;
+        for (int code = 0; code < wordList->len; code++) {
+            codes += uses[code];
+            int wordLen = wordList->spans[code].length;
+            if (wordLen > 1 && uses[code] > 0) {
+                memcpy(chosen[count].word,
+                       wordList->pool + wordList->spans[code].offset, wordLen);
+                chosen[count].word[wordLen] = '\0';
+                chosen[count].len = wordLen;
+                chosen[count].saving = uses[code] * (wordLen - 1);
+                count++;
+            }
+        }
+        freeWordList(wordList);
+        qsort(chosen, count, sizeof(Candidate), compareCandidates);
+
+        // Go back to the best list if this one was worse
+        if (codes < bestCodes) {
+            bestCodes = codes;
+            bestCount = count;
+            memcpy(best, chosen, count * sizeof(Candidate));
+        } else {
+            count = bestCount;
+            memcpy(chosen, best, count * sizeof(Candidate));
+        }
+
+        // Replace the weakest words with new candidates
+        if (next == candidateCount) {
+            break;
+        }
+        if (count == room) {
+            count -= room / REFILL_SHARE;
+        }
+        while (count < room && next < candidateCount) {
+            chosen[count++] = candidates[next++];
+        }
+    }
+    free(uses);
+    free(chosen);
+
+    return bestCount;
+}
+
+/**
+ * Writes the chosen words as a word file readWordList() accepts.
+ *
+ * @param fname The name of the word file
+ * @param chosen The words
+ * @param count The number of words
+ */
+void writeWords(char *fname, Candidate *chosen, int count)
+{
+    FILE *fp = fopen(fname, "w");
+    if (!fp) {
+        fprintf(stderr, FILE_ERROR, fname);
+        exit(EXIT_FAILURE);
+    }
+    for (int i = 0; i < count; i++) {
+        fprintf(fp, "%d %s\n", chosen[i].len, chosen[i].word);
+    }
+    fclose(fp);
+}
+
+/**
+ * Program starting point.  Trains a word file on the given corpus.
+ *
+ * @param argc Number of command-line arguments
+ * @param argv List of command-line arguments
+ * @return The program's exit status
+ */
+int main( int argc, char *argv[] )
+{
+    // Pull out any options, leaving just the file names
+    bool optimal = false;
+    int codeBits = BITS_PER_CODE;
+    long sampleSize = DEFAULT_SAMPLE;
+    int count = 1;
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], OPTIMAL_OPT) == 0) {
+            optimal = true;
+        } else if (strcmp(argv[i], WIDTH_OPT) == 0) {
+            if (i + 1 == argc || (codeBits = atoi(argv[++i])) < MIN_CODE_BITS
+                || codeBits > MAX_CODE_BITS) {
+                error(USAGE);
+            }
+        } else if (strcmp(argv[i], SAMPLE_OPT) == 0) {
+            if (i + 1 == argc || (sampleSize = atol(argv[++i])) < 1
+                || sampleSize > UINT32_MAX / 2) {
+                error(USAGE);
+            }
+        } else {
+            argv[count++] = argv[i];
+        }
+    }
+    argc = count;
+
+    if (argc != CMD_ARGS) {
+        error(USAGE);
+    }
+    int maxCodes = 1 << codeBits;
+
+    size_t len;
+    char *sample = readSample(argv[1], sampleSize, &len);
+
+    GramTable table = { sample, (Gram *)calloc(TABLE_SIZE, sizeof(Gram)), 0,
+                        0 };
+    countGrams(&table, sample, len);
+
+    int candidateCount;
+    Candidate *candidates = makeCandidates(&table, maxCodes
+                                           * CANDIDATES_PER_CODE,
+                                           &candidateCount);
+    free(table.slots);
+
+    Candidate *chosen = (Candidate *)malloc(maxCodes * sizeof(Candidate));
+    int chosenCount = chooseWords(candidates, candidateCount, sample, len,
+                                  maxCodes, optimal, chosen);
+    writeWords(argv[2], chosen, chosenCount);
+
+    free(candidates);
+    free(chosen);
+    free(sample);
+
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,556 @@
+/**
+ * @file wpbench.c
+ * @author Sam Whitlock (sjwhitlo)
+ *
+ * Benchmark for pack and unpack, run by make bench.  It generates
+ * deterministic corpora of English-like text, log lines and random
+ * printable chars at each of the sizes given, then packs and unpacks
+ * each one with words.txt and altwords.txt, checking the round trip.
+ *
+ * Each run is reported on a line of tab separated fields: the corpus,
+ * its size, the word file, pack or unpack, MB/s of uncompressed text,
+ * the compressed size as a share of the original, and the peak
+ * resident set size of the process in kB.  With --save, the results are
+ * written to a baseline file, and with --baseline, each run is compared
+ * with the same run in an earlier baseline.
+ */
+
+#define _DEFAULT_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/resource.h>
+#include <sys/wait.h>
+
+/** Usage message. */
+#define USAGE "usage: wpbench [--sizes 1M,16M,...] [--save baseline.tsv] " \
+              "[--baseline baseline.tsv] [--dir work_dir]"
+/** Option for the corpus sizes, followed by a comma separated list. */
+#define SIZES_OPT "--sizes"
+/** Option for saving the results, followed by a file name. */
+#define SAVE_OPT "--save"
+/** Option for comparing with earlier results, followed by a file name. */
+#define BASELINE_OPT "--baseline"
+/** Option for the directory corpora are written to, followed by its name. */
+#define DIR_OPT "--dir"
+/** Sizes used if none are given. */
+#define DEFAULT_SIZES "1M,16M"
+/** Most sizes that can be given. */
+#define MAX_SIZES 16
+/** Longest file name built. */
+#define NAME_MAX_LEN 1024
+/** Header line of the results. */
+#define HEADER "corpus\tbytes\twords\top\tMB/s\tratio\tpeak_kB"
+/** Format of a line of results. */
+#define RESULT_FORMAT "%s\t%lu\t%s\t%s\t%.1f\t%.4f\t%ld"
+/** Format for reading a line of results from a baseline. */
+#define BASELINE_FORMAT "%31s %lu %31s %7s %lf %lf %ld"
+/** Most lines read from a baseline. */
+#define MAX_BASELINE 1024
+/** Change in speed from the baseline that's reported as a regression. */
+#define SLOWER_SHARE 0.9
+/** Bytes in a megabyte, for reporting throughput. */
+#define MEGABYTE 1e6
+/** Size of the buffer corpora are generated in. */
+#define GEN_BUFFER 65536
+/** Column lines of generated text are wrapped at. */
+#define WRAP_COLUMN 72
+
+/** Kinds of corpus generated. */
+static const char *corpora[] = { "english", "logs", "random" };
+
+/** Word files each corpus is packed with. */
+static const char *wordFiles[] = { "words.txt", "altwords.txt" };
+
+/** Common English words, most common first, for English-like text. */
+static const char *vocabulary[] = {
+    "the", "of", "and", "to", "a", "in", "is", "it", "you", "that", "he",
+    "was", "for", "on", "are", "with", "as", "I", "his", "they", "be", "at",
+    "one", "have", "this", "from", "or", "had", "by", "not", "word", "but",
+    "what", "some", "we", "can", "out", "other", "were", "all", "there",
+    "when", "up", "use", "your", "how", "said", "an", "each", "she", "which",
+    "do", "their", "time", "if", "will", "way", "about", "many", "then",
+    "them", "write", "would", "like", "so", "these", "her", "long", "make",
+    "thing", "see", "him", "two", "has", "look", "more", "day", "could",
+    "go", "come", "did", "number", "sound", "no", "most", "people", "my",
+    "over", "know", "water", "than", "call", "first", "who", "may", "down",
+    "side", "been", "now", "find", "any", "new", "work", "part", "take",
+    "get", "place", "made", "live", "where", "after", "back", "little",
+    "only", "round", "man", "year", "came", "show", "every", "good", "me",
+    "give", "our", "under", "name", "very", "through", "just", "form",
+    "sentence", "great", "think", "say", "help", "low", "line", "differ",
+    "turn", "cause", "much", "mean", "before", "move", "right", "boy", "old",
+    "too", "same", "tell", "does", "set", "three", "want", "air", "well",
+    "also", "play", "small", "end", "put", "home", "read", "hand", "port",
+    "large", "spell", "add", "even", "land", "here", "must", "big", "high",
+    "such", "follow", "act", "why", "ask", "men", "change", "went", "light",
+    "kind", "off", "need", "house", "picture", "try", "us", "again",
+    "animal", "point", "mother", "world", "near", "build", "self", "earth",
+    "father", "head", "stand", "own", "page", "should", "country", "found",
+    "answer", "school", "grow", "study", "still", "learn", "plant", "cover"
+};
+
+/** Log levels, most common first. */
+static const char *levels[] = { "INFO", "INFO", "INFO", "DEBUG", "WARN", "ERROR" };
+
+/** Services named in log lines. */
+static const char *services[] = { "api", "auth", "billing", "cache", "db",
+                                  "queue", "scheduler", "worker" };
+
+/** Request paths named in log lines. */
+static const char *paths[] = { "/api/v1/users", "/api/v1/orders", "/login",
+                               "/api/v1/items/search", "/health", "/static/app.js",
+                               "/api/v2/reports/daily", "/logout" };
+
+/** Number of elements in an array. */
+#define COUNT( a ) ( sizeof( a ) / sizeof( ( a )[ 0 ] ) )
+
+/** One line of results. */
+typedef struct {
+  /** The kind of corpus. */
+  char corpus[ 32 ];
+
+  /** Its size. */
+  unsigned long bytes;
+
+  /** The word file. */
+  char words[ 32 ];
+
+  /** pack or unpack. */
+  char op[ 8 ];
+
+  /** MB/s of uncompressed text. */
+  double mbps;
+
+  /** Compressed size over uncompressed size. */
+  double ratio;
+
+  /** Peak resident set size, in kB. */
+  long peak;
+} Result;
+
+/**
+ * Prints an error message passed in as a paramater.
+ *
+ * @param message a pointer to the message to be printed.
+ */
+void error(char *message)
+{
+    fprintf(stderr, "%s\n", message);
+    exit(EXIT_FAILURE);
+}
+
+/**
+ * Returns the next number from a xorshift generator, so the corpora are
+ * the same on every machine.
+ *
+ * @param state The generator's state, which is updated
+ * @return A random number
+ */
+uint64_t nextRandom(uint64_t *state)
+{
+    uint64_t x = *state;
+    x ^= x >> 12;
+    x ^= x << 25;
+    x ^= x >> 27;
+    *state = x;
+    return x * 0x2545F4914F6CDD1DULL;
+}
+
+/**
+ * Returns a random number below n, skewed toward small numbers so the
+ * first entries of a list come up much more often, like real words.
+ *
+ * @param state The generator's state
+ * @param n The number of choices
+ * @return A number from 0 to n - 1
+ */
+int skewedChoice(uint64_t *state, int n)
+{
+    uint64_t a = nextRandom(state) % n;
+    uint64_t b = nextRandom(state) % n;
+    return (int)(a * b / n);
+}
+
+/**
+ * Adds a sentence of English-like text to a buffer, wrapping lines.
+ *
+ * @param state The generator's state
+ * @param buf The buffer, with room for a few hundred more chars
+ * @param len The number of chars in the buffer, which is updated
+ * @param column The column the next char goes in, which is updated
+ */
+void addSentence(uint64_t *state, char *buf, size_t *len, int *column)
+{
+    int words = 4 + nextRandom(state) % 16;
+    for (int w = 0; w < words; w++) {
+        char word[32];
+        strcpy(word, vocabulary[skewedChoice(state, COUNT(vocabulary))]);
+        if (w == 0) {
+            word[0] = word[0] >= 'a' && word[0] <= 'z' ? word[0] - 'a' + 'A' : word[0];
+        }
+        if (w == words - 1) {
+            strcat(word, nextRandom(state) % 8 ? "." : "?");
+        } else if (nextRandom(state) % 10 == 0) {
+            strcat(word, ",");
+        }
+
+        // A space before each word, or a new line if it won't fit
+        int wordLen = strlen(word);
+        if (*column > 0 && *column + 1 + wordLen > WRAP_COLUMN) {
+            buf[(*len)++] = '\n';
+            *column = 0;
+        } else if (*column > 0) {
+            buf[(*len)++] = ' ';
+            (*column)++;
+        }
+        memcpy(buf + *len, word, wordLen);
+        *len += wordLen;
+        *column += wordLen;
+    }
+
+    // Sometimes end the paragraph
+    if (nextRandom(state) % 6 == 0) {
+        memcpy(buf + *len, "\n\n", 2);
+        *len += 2;
+        *column = 0;
+    }
+}
+
+/**
+ * Adds a log line to a buffer.
+ *
+ * @param state The generator's state
+ * @param buf The buffer, with room for a few hundred more chars
+ * @param len The number of chars in the buffer, which is updated
+ * @param millis Milliseconds since the start of the log, which is
+ * updated
+ */
+void addLogLine(uint64_t *state, char *buf, size_t *len, uint64_t *millis)
+{
+    *millis += nextRandom(state) % 250;
+    uint64_t seconds = *millis / 1000;
+    *len += sprintf(buf + *len,
+                    "2024-03-%02d %02d:%02d:%02d.%03d %-5s [%s-%d] ",
+                    (int)(1 + seconds / 86400 % 28), (int)(seconds / 3600 % 24),
+                    (int)(seconds / 60 % 60), (int)(seconds % 60),
+                    (int)(*millis % 1000),
+                    levels[nextRandom(state) % COUNT(levels)],
+                    services[skewedChoice(state, COUNT(services))],
+                    (int)(nextRandom(state) % 8));
+    int status = nextRandom(state) % 20 ? 200 : 404 + nextRandom(state) % 100;
+    *len += sprintf(buf + *len,
+                    "request id=%08x method=%s path=%s status=%d ms=%d\n",
+                    (unsigned)(nextRandom(state) & 0xFFFFFFFF),
+                    nextRandom(state) % 4 ? "GET" : "POST",
+                    paths[skewedChoice(state, COUNT(paths))], status,
+                    (int)(nextRandom(state) % 900 + 1));
+}
+
+/**
+ * Writes a corpus of exactly the given size.
+ *
+ * @param kind Which kind of corpus, an index into corpora
+ * @param size The number of chars
+ * @param fname The file to write it to
+ */
+void generateCorpus(int kind, unsigned long size, const char *fname)
+{
+    FILE *fp = fopen(fname, "w");
+    if (!fp) {
+        error("Can't write corpus");
+    }
+
+    // Every corpus of a kind starts the same way
+    uint64_t state = 0x9E3779B97F4A7C15ULL + kind;
+    char *buf = (char *)malloc(GEN_BUFFER + 1024);
+    int column = 0;
+    uint64_t millis = 0;
+    unsigned long written = 0;
+    while (written < size) {
+        size_t len = 0;
+        while (len < GEN_BUFFER) {
+            if (kind == 0) {
+                addSentence(&state, buf, &len, &column);
+            } else if (kind == 1) {
+                addLogLine(&state, buf, &len, &millis);
+            } else {
+                uint64_t r = nextRandom(&state);
+                buf[len++] = r % 80 == 0 ? '\n' : ' ' + (r >> 8) % ('~' - ' ' + 1);
+            }
+        }
+        if (len > size - written) {
+            len = size - written;
+        }
+        fwrite(buf, 1, len, fp);
+        written += len;
+    }
+
+    free(buf);
+    fclose(fp);
+}
+
+/**
+ * Runs a program and waits for it to finish.
+ *
+ * @param args The program and its arguments, ending with NULL
+ * @param seconds Set to how long it took
+ * @param peak Set to its peak resident set size, in kB
+ * @return true if it exited successfully
+ */
+bool runProgram(char *const args[], double *seconds, long *peak)
+{
+    struct timespec start, end;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    pid_t pid = fork();
+    if (pid == 0) {
+        execv(args[0], args);
+        _exit(127);
+    }
+    int status;
+    struct rusage usage;
+    if (pid < 0 || wait4(pid, &status, 0, &usage) != pid) {
+        return false;
+    }
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    *seconds = end.tv_sec - start.tv_sec + (end.tv_nsec - start.tv_nsec) / 1e9;
+    *peak = usage.ru_maxrss;
+    return WIFEXITED(status) && WEXITSTATUS(status) == 0;
+}
+
+/**
+ * Returns the size of a file.
+ *
+ * @param fname The name of the file
+ * @return Its size in bytes, or 0 if it can't be opened
+ */
+unsigned long fileSize(const char *fname)
+{
+    FILE *fp = fopen(fname, "rb");
+    if (!fp) {
+        return 0;
+    }
+    fseek(fp, 0, SEEK_END);
+    unsigned long size = ftell(fp);
+    fclose(fp);
+    return size;
+}
+
+/**
+ * Checks whether two files have the same contents.
+ *
+ * @param a The name of the first file
+ * @param b The name of the second file
+ * @return true if they're the same
+ */
+bool sameFiles(const char *a, const char *b)
+{
+    FILE *fa = fopen(a, "rb");
+    FILE *fb = fopen(b, "rb");
+    bool same = fa && fb;
+    char bufA[GEN_BUFFER], bufB[GEN_BUFFER];
+    while (same) {
+        size_t lenA = fread(bufA, 1, sizeof(bufA), fa);
+        size_t lenB = fread(bufB, 1, sizeof(bufB), fb);
+        same = lenA == lenB && memcmp(bufA, bufB, lenA) == 0;
+        if (lenA == 0) {
+            break;
+        }
+    }
+    if (fa) {
+        fclose(fa);
+    }
+    if (fb) {
+        fclose(fb);
+    }
+    return same;
+}
+
+/**
+ * Parses a size like 1M, with an optional K, M or G suffix.
+ *
+ * @param str The size
+ * @return The number of bytes, or 0 if it isn't valid
+ */
+unsigned long parseSize(const char *str)
+{
+    char *end;
+    unsigned long size = strtoul(str, &end, 10);
+    if (*end == 'K' || *end == 'k') {
+        size <<= 10;
+        end++;
+    } else if (*end == 'M' || *end == 'm') {
+        size <<= 20;
+        end++;
+    } else if (*end == 'G' || *end == 'g') {
+        size <<= 30;
+        end++;
+    }
+    return *end == '\0' ? size : 0;
+}
+
+/**
+ * Reads the results saved in a baseline file.
+ *
+ * @param fname The name of the file
+ * @param results Array for the results, with room for MAX_BASELINE
+ * @return The number of results read
+ */
+int readBaseline(const char *fname, Result *results)
+{
+    FILE *fp = fopen(fname, "r");
+    if (!fp) {
+        error("Can't open baseline");
+    }
+
+    // Skip the header, then read every line that parses
+    char line[NAME_MAX_LEN];
+    int count = 0;
+    while (fgets(line, sizeof(line), fp) && count < MAX_BASELINE) {
+        Result *r = results + count;
+        if (sscanf(line, BASELINE_FORMAT, r->corpus, &r->bytes, r->words,
+                   r->op, &r->mbps, &r->ratio, &r->peak) == 7) {
+            count++;
+        }
+    }
+    fclose(fp);
+    return count;
+}
+
+/**
+ * Prints a result, followed by how it compares with the same run in a
+ * baseline, if there is one.
+ *
+ * @param fp The file to print to
+ * @param r The result
+ * @param baseline The baseline results
+ * @param baseCount The number of baseline results
+ */
+void printResult(FILE *fp, const Result *r, const Result *baseline, int baseCount)
+{
+    fprintf(fp, RESULT_FORMAT, r->corpus, r->bytes, r->words, r->op,
+            r->mbps, r->ratio, r->peak);
+    for (int i = 0; i < baseCount; i++) {
+        const Result *b = baseline + i;
+        if (strcmp(b->corpus, r->corpus) == 0 && b->bytes == r->bytes
+            && strcmp(b->words, r->words) == 0 && strcmp(b->op, r->op) == 0) {
+            fprintf(fp, "\t%+.1f%%%s", (r->mbps / b->mbps - 1) * 100,
+                    r->mbps < b->mbps * SLOWER_SHARE ? "\tSLOWER" : "");
+            break;
+        }
+    }
+    fprintf(fp, "\n");
+}
+
+/**
+ * Runs the benchmark.
+ *
+ * @param argc the number of command line arguments
+ * @param argv the command line arguments
+ */
+int main(int argc, char *argv[])
+{
+    char *sizeList = DEFAULT_SIZES;
+    char *saveFile = NULL;
+    char *baselineFile = NULL;
+    char *dir = ".";
+    for (int i = 1; i < argc; i++) {
+        if (i + 1 == argc) {
+            error(USAGE);
+        } else if (strcmp(argv[i], SIZES_OPT) == 0) {
+            sizeList = argv[++i];
+        } else if (strcmp(argv[i], SAVE_OPT) == 0) {
+            saveFile = argv[++i];
+        } else if (strcmp(argv[i], BASELINE_OPT) == 0) {
+            baselineFile = argv[++i];
+        } else if (strcmp(argv[i], DIR_OPT) == 0) {
+            dir = argv[++i];
+        } else {
+            error(USAGE);
+        }
+    }
+
+    unsigned long sizes[MAX_SIZES];
+    int sizeCount = 0;
+    char *copy = strdup(sizeList);
+    for (char *tok = strtok(copy, ","); tok; tok = strtok(NULL, ",")) {
+        if (sizeCount == MAX_SIZES || (sizes[sizeCount++] = parseSize(tok)) == 0) {
+            error(USAGE);
+        }
+    }
+    free(copy);
+
+    Result *baseline = (Result *)malloc(MAX_BASELINE * sizeof(Result));
+    int baseCount = baselineFile ? readBaseline(baselineFile, baseline) : 0;
+    FILE *save = NULL;
+    if (saveFile && !(save = fopen(saveFile, "w"))) {
+        error("Can't write baseline");
+    }
+    printf("%s\n", HEADER);
+    if (save) {
+        fprintf(save, "%s\n", HEADER);
+    }
+
+    char corpus[NAME_MAX_LEN], packed[NAME_MAX_LEN], unpacked[NAME_MAX_LEN];
+    snprintf(packed, sizeof(packed), "%s/bench.raw", dir);
+    snprintf(unpacked, sizeof(unpacked), "%s/bench.out", dir);
+    bool ok = true;
+    for (int s = 0; s < sizeCount; s++) {
+        for (int k = 0; k < COUNT(corpora); k++) {
+            snprintf(corpus, sizeof(corpus), "%s/bench_%s.txt", dir, corpora[k]);
+            generateCorpus(k, sizes[s], corpus);
+
+            for (int w = 0; w < COUNT(wordFiles); w++) {
+                char *packArgs[] = { "./pack", corpus, packed, (char *)wordFiles[w], NULL };
+                char *unpackArgs[] = { "./unpack", packed, unpacked, (char *)wordFiles[w], NULL };
+                Result r;
+                strcpy(r.corpus, corpora[k]);
+                strcpy(r.words, wordFiles[w]);
+                r.bytes = sizes[s];
+
+                // Time each direction, and make sure the text came back.
+                // Output from the last run is removed first, so it can't
+                // be mistaken for this one's.
+                remove(packed);
+                remove(unpacked);
+                double seconds;
+                bool ran = true;
+                for (int op = 0; op < 2; op++) {
+                    strcpy(r.op, op == 0 ? "pack" : "unpack");
+                    if (!runProgram(op == 0 ? packArgs : unpackArgs, &seconds, &r.peak)) {
+                        fprintf(stderr, "%s failed on %s\n", r.op, corpus);
+                        ran = false;
+                        break;
+                    }
+                    r.mbps = seconds > 0 ? sizes[s] / MEGABYTE / seconds : 0;
+                    r.ratio = (double)fileSize(packed) / sizes[s];
+                    printResult(stdout, &r, baseline, baseCount);
+                    if (save) {
+                        printResult(save, &r, NULL, 0);
+                    }
+                    fflush(stdout);
+                }
+                if (ran && !sameFiles(corpus, unpacked)) {
+                    fprintf(stderr, "Round trip failed on %s with %s\n",
+                            corpus, wordFiles[w]);
+                    ran = false;
+                }
+                ok = ok && ran;
+            }
+            remove(corpus);
+        }
+    }
+    remove(packed);
+    remove(unpacked);
+
+    if (save) {
+        fclose(save);
+    }
+    free(baseline);
+    return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,94 @@
+/**
+ * @file wpstream.c
+ * @author Sam Whitlock (sjwhitlo)
+ *
+ * Example client of libwordpack.  Compresses or uncompresses standard
+ * input to standard output, handing it to the library a given number of
+ * bytes at a time, so the output should match pack and unpack for any
+ * piece size.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+
+#include "wordpack.h"
+
+/** Usage message. */
+#define USAGE "usage: wpstream <c|d> <word_file.txt> <piece_size>"
+/** Expected number of command line arguments. */
+#define CMD_ARGS 4
+/** Bits per code, the same as pack's default. */
+#define CODE_BITS 9
+
+/**
+ * Prints an error message for a library error code and exits.
+ *
+ * @param status The error code
+ */
+void fail(int status)
+{
+    fprintf(stderr, "%s\n", wp_error_string(status));
+    exit(EXIT_FAILURE);
+}
+
+/**
+ * Program starting point.
+ *
+ * @param argc Number of command-line arguments
+ * @param argv List of command-line arguments
+ * @return The program's exit status
+ */
+int main( int argc, char *argv[] )
+{
+    int size;
+    if (argc != CMD_ARGS || (strcmp(argv[1], "c") != 0
+                             && strcmp(argv[1], "d") != 0)
+        || (size = atoi(argv[3])) < 1) {
+        fprintf(stderr, "%s\n", USAGE);
+        return EXIT_FAILURE;
+    }
+    bool compress = argv[1][0] == 'c';
+
+    WpDict *dict;
+    int status = wp_dict_load(argv[2], CODE_BITS, &dict);
+    if (status != WP_OK) {
+        fail(status);
+    }
+
+    // Room for the most output a piece can produce either way
+    size_t cap = compress ? wp_compress_bound(size)
+                          : wp_decompress_bound(dict, size);
+    char *in = (char *)malloc(size);
+    char *out = (char *)malloc(cap);
+    WpCompressor *compressor = NULL;
+    WpDecompressor *decompressor = NULL;
+    status = compress ? wp_compress_new(dict, &compressor)
+                      : wp_decompress_new(dict, &decompressor);
+
+    size_t len;
+    size_t written;
+    while (status == WP_OK && (len = fread(in, 1, size, stdin)) > 0) {
+        status = compress
+            ? wp_compress_update(compressor, in, len, out, cap, &written)
+            : wp_decompress_update(decompressor, in, len, out, cap, &written);
+        fwrite(out, 1, written, stdout);
+    }
+    if (status == WP_OK) {
+        status = compress
+            ? wp_compress_finish(compressor, out, cap, &written)
+            : wp_decompress_finish(decompressor, out, cap, &written);
+        fwrite(out, 1, written, stdout);
+    }
+    if (status != WP_OK) {
+        fail(status);
+    }
+
+    wp_compress_free(compressor);
+    wp_decompress_free(decompressor);
+    wp_dict_free(dict);
+    free(in);
+    free(out);
+    return EXIT_SUCCESS;
+}